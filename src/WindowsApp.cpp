@@ -1,5 +1,8 @@
 #include "WindowsApp.h"
+#include "framebuffer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <array>
@@ -42,6 +45,16 @@ bool WindowsApp::setup(int width, int height, std::string title)
 	//Get window surface
 	m_screen_surface = SDL_GetWindowSurface(m_window_handle);
 
+	//Redraws pack pixels themselves instead of calling SDL_MapRGB when the surface holds
+	//32-bit truecolor pixels, which is what window surfaces are in practice
+	const SDL_PixelFormat* format = m_screen_surface->format;
+	m_fast_pixel_format = format->BytesPerPixel == 4 && format->palette == nullptr
+		&& format->Rloss == 0 && format->Gloss == 0 && format->Bloss == 0;
+	m_red_shift = format->Rshift;
+	m_green_shift = format->Gshift;
+	m_blue_shift = format->Bshift;
+	m_alpha_bits = format->Amask;
+
 	return true;
 }
 
@@ -57,7 +70,10 @@ WindowsApp::~WindowsApp()
 
 void WindowsApp::processEvent()
 {
+	//Deltas sum the motion since the previous call
 	m_wheel_delta = 0;
+	m_mouse_delta_x = 0;
+	m_mouse_delta_y = 0;
 	//Handle events queue
 	while (SDL_PollEvent(&m_events) != 0)
 	{
@@ -75,13 +91,11 @@ void WindowsApp::processEvent()
 				firstEvent = false;
 				m_last_mouse_x = m_events.motion.x;
 				m_last_mouse_y = m_events.motion.y;
-				m_mouse_delta_x = 0;
-				m_mouse_delta_y = 0;
 			}
 			else
 			{
-				m_mouse_delta_x = m_events.motion.x - m_last_mouse_x;
-				m_mouse_delta_y = m_events.motion.y - m_last_mouse_y;
+				m_mouse_delta_x += m_events.motion.x - m_last_mouse_x;
+				m_mouse_delta_y += m_events.motion.y - m_last_mouse_y;
 				m_last_mouse_x = m_events.motion.x;
 				m_last_mouse_y = m_events.motion.y;
 			}
@@ -89,10 +103,8 @@ void WindowsApp::processEvent()
 		if (m_events.type == SDL_MOUSEBUTTONDOWN && m_events.button.button == SDL_BUTTON_LEFT)
 		{
 			m_mouse_left_button_pressed = true;
-			m_last_mouse_x = m_events.motion.x;
-			m_last_mouse_y = m_events.motion.y;
-			m_mouse_delta_x = 0;
-			m_mouse_delta_y = 0;
+			m_last_mouse_x = m_events.button.x;
+			m_last_mouse_y = m_events.button.y;
 		}
 		if (m_events.type == SDL_MOUSEBUTTONUP && m_events.button.button == SDL_BUTTON_LEFT)
 		{
@@ -100,36 +112,75 @@ void WindowsApp::processEvent()
 		}
 		if (m_events.type == SDL_MOUSEWHEEL)
 		{
-			m_wheel_delta = m_events.wheel.y;
+			m_wheel_delta += m_events.wheel.y;
 		}
 	}
 }
 
-void WindowsApp::updateScreenSurface(const std::vector<std::vector<color>> &canvas)
+void WindowsApp::updateScreenSurface(framebuffer &fb)
 {
-	//Update pixels
-	int height = canvas.size();
-	int width = canvas[0].size();
+	//Update the pixels of the dirty tiles only
+	const tile_grid &grid = fb.tiles();
+	const int height = fb.height();
+	const SDL_PixelFormat* format = m_screen_surface->format;
+	std::vector<SDL_Rect> changed;
 	SDL_LockSurface(m_screen_surface);
 	{
-		Uint32* destPixels = (Uint32*)m_screen_surface->pixels;
-		for (int j = 0; j < height; ++j)
+		Uint8* destPixels = (Uint8*)m_screen_surface->pixels;
+		const int bytesPerPixel = format->BytesPerPixel;
+		int t;
+		while (fb.next_dirty(t))
 		{
-			for (int i = 0; i < width; ++i)
+			for (int j = grid.y0(t); j < grid.y1(t); ++j)
 			{
-				const auto &pixel = canvas[j][i];
-
-				Uint32 color = SDL_MapRGB(
-					m_screen_surface->format,
-					static_cast<uint8_t>(pixel[0] * 255),
-					static_cast<uint8_t>(pixel[1] * 255),
-					static_cast<uint8_t>(pixel[2] * 255));
-				destPixels[(height - 1 - j) * width + i] = color;
+				Uint8* destRow = destPixels + (height - 1 - j) * m_screen_surface->pitch;
+				for (int i = grid.x0(t); i < grid.x1(t); ++i)
+				{
+					// Gamma 2 from the linear estimate
+					const float* pixel = fb.pixel(i, j);
+					Uint32 r = static_cast<uint8_t>(std::min(std::sqrt(std::max(pixel[0], 0.0f)), 1.0f) * 255);
+					Uint32 g = static_cast<uint8_t>(std::min(std::sqrt(std::max(pixel[1], 0.0f)), 1.0f) * 255);
+					Uint32 b = static_cast<uint8_t>(std::min(std::sqrt(std::max(pixel[2], 0.0f)), 1.0f) * 255);
+					if (m_fast_pixel_format)
+					{
+						((Uint32*)destRow)[i] = (r << m_red_shift) | (g << m_green_shift) | (b << m_blue_shift) | m_alpha_bits;
+						continue;
+					}
+					//Other formats store BytesPerPixel bytes of the mapped value
+					Uint32 color = SDL_MapRGB(format, r, g, b);
+					Uint8* dest = destRow + i * bytesPerPixel;
+					switch (bytesPerPixel)
+					{
+					case 1:
+						*dest = static_cast<Uint8>(color);
+						break;
+					case 2:
+						*(Uint16*)dest = static_cast<Uint16>(color);
+						break;
+					case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+						dest[0] = static_cast<Uint8>(color >> 16);
+						dest[1] = static_cast<Uint8>(color >> 8);
+						dest[2] = static_cast<Uint8>(color);
+#else
+						dest[0] = static_cast<Uint8>(color);
+						dest[1] = static_cast<Uint8>(color >> 8);
+						dest[2] = static_cast<Uint8>(color >> 16);
+#endif
+						break;
+					default:
+						*(Uint32*)dest = color;
+						break;
+					}
+				}
 			}
+			SDL_Rect rect = { grid.x0(t), height - grid.y1(t), grid.x1(t) - grid.x0(t), grid.y1(t) - grid.y0(t) };
+			changed.push_back(rect);
 		}
 	}
 	SDL_UnlockSurface(m_screen_surface);
-	SDL_UpdateWindowSurface(m_window_handle);
+	if (!changed.empty())
+		SDL_UpdateWindowSurfaceRects(m_window_handle, changed.data(), static_cast<int>(changed.size()));
 }
 
 WindowsApp::ptr WindowsApp::getInstance()
@@ -10,6 +10,8 @@
 
 #include "vec3.h"
 
+class framebuffer;
+
 class WindowsApp final
 {
 private:
@@ -32,7 +34,8 @@ public:
 	int getMouseWheelDelta() const { return m_wheel_delta; }
 	bool getIsMouseLeftButtonPressed() const { return m_mouse_left_button_pressed; }
 
-	void updateScreenSurface(const std::vector<std::vector<color>> &canvas);
+	// Redraws the tiles the renderer has published since the last call
+	void updateScreenSurface(framebuffer &fb);
 
 	static WindowsApp::ptr getInstance();
 	static WindowsApp::ptr getInstance(int width, int height, const std::string title = "winApp");
@@ -62,6 +65,11 @@ private:
 	SDL_Window* m_window_handle = nullptr;
 	SDL_Surface* m_screen_surface = nullptr;
 
+	//How 8-bit RGB packs into the surface's pixels, worked out once from its format
+	bool m_fast_pixel_format = false;
+	Uint32 m_red_shift = 0, m_green_shift = 0, m_blue_shift = 0;
+	Uint32 m_alpha_bits = 0;
+
 	//Singleton pattern
 	static WindowsApp::ptr m_instance;
 };
@@ -13,6 +13,13 @@ public:
 
 	point3 min() const { return minimum; }
 	point3 max() const { return maximum; }
+	point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+	double surface_area() const
+	{
+		vec3 d = maximum - minimum;
+		return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+	}
 
 	bool hit(const ray& r, double t_min, double t_max) const
 	{
@@ -35,7 +42,7 @@ public:
 	point3 maximum;
 };
 
-aabb surrounding_box(aabb box0, aabb box1) 
+inline aabb surrounding_box(aabb box0, aabb box1)
 {
 	point3 small(fmin(box0.min().x(), box1.min().x()),
 		fmin(box0.min().y(), box1.min().y()),
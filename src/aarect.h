@@ -22,14 +22,29 @@ public:
 		if (x < x0 || x > x1 || y < y0 || y > y1)
 			return false;
 
-		rec.u = (x - x0) / (x1 - x0);
-		rec.v = (y - y0) / (y1 - y0);
 		rec.t = t;
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
+		rec.p = r.at(rec.t);
+		rec.u = (rec.p.x() - x0) / (x1 - x0);
+		rec.v = (rec.p.y() - y0) / (y1 - y0);
 		auto outward_normal = vec3(0, 0, 1);
 		rec.set_face_normal(r, outward_normal);
-		rec.mat_ptr = mp;
-		rec.p = r.at(t);
-		return true;
+		rec.mat_ptr = mp.get();
+	}
+
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		auto t = (k - r.origin().z()) / r.direction().z();
+		if (t < t_min || t > t_max)
+			return false;
+		auto x = r.origin().x() + t * r.direction().x();
+		auto y = r.origin().y() + t * r.direction().y();
+		return x >= x0 && x <= x1 && y >= y0 && y <= y1;
 	}
 
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
@@ -62,14 +77,29 @@ public:
 		if (x < x0 || x > x1 || z < z0 || z > z1)
 			return false;
 
-		rec.u = (x - x0) / (x1 - x0);
-		rec.v = (z - z0) / (z1 - z0);
 		rec.t = t;
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
+		rec.p = r.at(rec.t);
+		rec.u = (rec.p.x() - x0) / (x1 - x0);
+		rec.v = (rec.p.z() - z0) / (z1 - z0);
 		auto outward_normal = vec3(0, 1, 0);
 		rec.set_face_normal(r, outward_normal);
-		rec.mat_ptr = mp;
-		rec.p = r.at(t);
-		return true;
+		rec.mat_ptr = mp.get();
+	}
+
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		auto t = (k - r.origin().y()) / r.direction().y();
+		if (t < t_min || t > t_max)
+			return false;
+		auto x = r.origin().x() + t * r.direction().x();
+		auto z = r.origin().z() + t * r.direction().z();
+		return x >= x0 && x <= x1 && z >= z0 && z <= z1;
 	}
 
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
@@ -87,16 +117,16 @@ public:
 		{
 			double area = fabs((x1 - x0) * (z1 - z0));
 			double distance_squared = rec.t * rec.t * v.length_squared();
-			double cosine = fabs(dot(v, rec.normal) / v.length());
+			double cosine = fabs(v.y() / v.length());
 			return distance_squared / (cosine * area);
 		}
 		else
 			return 0;
 	}
 
-	virtual vec3 random(const vec3& o) const override
+	virtual vec3 random(const vec3& o, double r1, double r2) const override
 	{
-		vec3 random_point = vec3(x0 + random_double() * (x1 - x0), k, z0 + random_double() * (z1 - z0));
+		vec3 random_point = vec3(x0 + r1 * (x1 - x0), k, z0 + r2 * (z1 - z0));
 		return random_point - o;
 	}
 
@@ -124,14 +154,29 @@ public:
 		if (y < y0 || y > y1 || z < z0 || z > z1)
 			return false;
 
-		rec.u = (y - y0) / (y1 - y0);
-		rec.v = (z - z0) / (z1 - z0);
 		rec.t = t;
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
+		rec.p = r.at(rec.t);
+		rec.u = (rec.p.y() - y0) / (y1 - y0);
+		rec.v = (rec.p.z() - z0) / (z1 - z0);
 		auto outward_normal = vec3(1, 0, 0);
 		rec.set_face_normal(r, outward_normal);
-		rec.mat_ptr = mp;
-		rec.p = r.at(t);
-		return true;
+		rec.mat_ptr = mp.get();
+	}
+
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		auto t = (k - r.origin().x()) / r.direction().x();
+		if (t < t_min || t > t_max)
+			return false;
+		auto y = r.origin().y() + t * r.direction().y();
+		auto z = r.origin().z() + t * r.direction().z();
+		return y >= y0 && y <= y1 && z >= z0 && z <= z1;
 	}
 
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
@@ -0,0 +1,101 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Adaptive sampling is off by default, so every pixel gets exactly samples_per_pixel. When it
+// is on, samples_per_pixel becomes the most a pixel gets.
+struct adaptive_settings
+{
+	bool enabled = false;
+	int min_spp = 16;				// samples every pixel gets before its error is checked
+	int max_spp = 1024;
+	int pass_spp = 16;				// samples added to unconverged tiles per pass
+	double error_threshold = 0.05;	// a tile stops once its worst pixel's relative standard error is below this
+};
+
+// Progressive rendering sweeps the whole frame a pass at a time, so the display refines
+// everywhere at once and the render can stop after any pass. The first pass takes pass_spp
+// samples per pixel and every later one twice as many as the last, up to max_pass_spp: the
+// first image comes quickly, and a long render still opens few passes, each of which starts
+// the threads and sets up their samplers and arenas again. Sample
+// indices do not depend on how they are split into passes, so letting it run to max_spp gives
+// the one-shot image. With a time budget the render stops handing out tiles once it is spent,
+// and every pixel is normalised by its own sample count. Previews give an interactive viewer
+// something to show within moments of a camera move; their samples are not kept.
+struct progressive_settings
+{
+	bool enabled = true;
+	int pass_spp = 1;		// samples per pixel of the first pass
+	int max_pass_spp = 64;	// the most a later pass grows to
+	int max_passes = 0;		// 0 renders until every tile is done
+	double time_budget = 0;	// seconds; when positive it replaces samples_per_pixel as the limit
+	bool preview = false;	// first draw the framebuffer at 1/8 and then 1/4 resolution
+
+	// Samples per pixel of pass number pass, counted from 0
+	int pass_size(int pass) const
+	{
+		int size = std::max(pass_spp, 1);
+		const int cap = std::max(max_pass_spp, size);
+		for (int k = 0; k < pass && size < cap; k++)
+			size = std::min(cap, 2 * size);
+		return size;
+	}
+};
+
+// Running mean of a pixel and Welford's running variance of its luminance.
+struct pixel_estimate
+{
+	color sum;
+	double mean_l = 0;
+	double m2_l = 0;
+	int n = 0;
+
+	void add(const color& c)
+	{
+		sum += c;
+		n++;
+		double l = luminance(c);
+		double delta = l - mean_l;
+		mean_l += delta / n;
+		m2_l += delta * (l - mean_l);
+	}
+
+	// Standard error of the mean over the mean. Dark pixels are measured against a floor
+	// so that near-black noise does not keep them sampling forever. A pixel that has not yet
+	// seen its rare bright paths looks converged on its own, which is why tiles decide together.
+	double relative_error() const
+	{
+		if (n < 2)
+			return infinity;
+		double standard_error = sqrt(m2_l / (n - 1) / n);
+		return standard_error / fmax(mean_l, 1e-2);
+	}
+};
+
+// Prints how many pixels stopped in each power-of-two spp bucket.
+inline void print_spp_histogram(const std::vector<pixel_estimate>& pixels, std::ostream& out)
+{
+	std::vector<size_t> buckets;
+	double total = 0;
+	for (const auto& p : pixels)
+	{
+		size_t b = 0;
+		while ((2 << b) <= p.n)
+			b++;
+		if (buckets.size() <= b)
+			buckets.resize(b + 1, 0);
+		buckets[b]++;
+		total += p.n;
+	}
+	out << "Samples per pixel (mean " << (pixels.empty() ? 0 : total / pixels.size()) << "):" << std::endl;
+	for (size_t b = 0; b < buckets.size(); b++)
+		if (buckets[b] > 0)
+			out << "  [" << (1 << b) << ", " << (2 << b) << "): " << buckets[b] << " pixels" << std::endl;
+}
+
+#endif // !ADAPTIVE_H
@@ -28,6 +28,11 @@ public:
 		return sides.hit(r, t_min, t_max, rec);
 	}
 
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		return sides.occluded(r, t_min, t_max);
+	}
+
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
 	{
 		output_box = aabb(box_min, box_max);
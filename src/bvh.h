@@ -4,91 +4,523 @@
 #include "rtweekend.h"
 #include "hitable.h"
 #include "hitable_list.h"
+#include "morton.h"
 #include <algorithm>
+#include <chrono>
+#include <memory>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-inline bool box_compare(const shared_ptr<hitable> a, const shared_ptr<hitable> b, int axis)
+enum class bvh_split_method
 {
-	aabb box_a, box_b;
-	if (!a->bounding_box(0, 0, box_a) || !b->bounding_box(0, 0, box_b))
+	random_median,	// split at the object-count median of a random axis
+	sah,			// binned surface area heuristic
+	lbvh			// linear-time hierarchy over Morton-sorted centroids; fastest build, lower quality
+};
+
+// Traversal stacks hold one entry per level, so no leaf lies deeper than this below the root
+const int bvh_max_depth = 64;
+
+// Leaves hold at most this many objects whatever the options ask for, so a linear_bvh node can count them
+const int bvh_max_leaf_size = UINT16_MAX;
+
+struct bvh_build_options
+{
+	bvh_split_method split_method = bvh_split_method::sah;
+	int max_leaf_size = 4;			// leaves never hold more objects than this
+	int sah_buckets = 12;			// centroid bins per axis
+	double traversal_cost = 1.0;	// cost of visiting an interior node (box test)
+	double intersection_cost = 1.0;	// cost of one object hit() test
+	size_t parallel_threshold = 1024;	// subtrees with fewer objects are built on the spawning thread
+	int morton_bits = 30;			// lbvh code length, 30 or 63
+};
+
+inline aabb object_box(const shared_ptr<hitable>& object, double time0, double time1)
+{
+	aabb box;
+	if (!object->bounding_box(time0, time1, box))
 		std::cerr << "No bounding box in bvh_node constructor.\n";
-	return box_a.min().e[axis] < box_b.min().e[axis];
+	return box;
 }
 
-bool box_x_compare(const shared_ptr<hitable> a, const shared_ptr<hitable> b)
+// Bounds of one scene object, gathered once before the build so splits never call bounding_box().
+struct bvh_primitive
 {
-	return box_compare(a, b, 0);
-}
+	aabb box;
+	point3 centroid;
+	size_t index;	// into the source object list
+};
 
-bool box_y_compare(const shared_ptr<hitable> a, const shared_ptr<hitable> b)
+// Node of the intermediate binary hierarchy. Leaves cover primitives[start, end) of the builder.
+struct bvh_build_node
 {
-	return box_compare(a, b, 1);
-}
+	aabb box;
+	size_t start, end;
+	int axis = 0;
+	std::unique_ptr<bvh_build_node> children[2];
+
+	bool is_leaf() const { return !children[0]; }
+};
 
-bool box_z_compare(const shared_ptr<hitable> a, const shared_ptr<hitable> b)
+inline int bucket_index(double c, double cmin, double extent, int nbuckets)
 {
-	return box_compare(a, b, 2);
+	int k = static_cast<int>(nbuckets * ((c - cmin) / extent));
+	return k < 0 ? 0 : (k >= nbuckets ? nbuckets - 1 : k);
 }
 
-class bvh_node : public hitable
+// Partitions prims[start, end) at the cheapest bucket boundary found by the binned SAH.
+// Returns false when a leaf is cheaper than any split and the span fits in one leaf.
+inline bool sah_split(std::vector<bvh_primitive>& prims, size_t start, size_t end, const aabb& bounds,
+	const bvh_build_options& options, size_t& mid, int& axis)
 {
-public:
-	bvh_node() = delete;
-	bvh_node(const hitable_list& list, double time0, double time1)
-		: bvh_node(list.objects, 0, list.objects.size(), time0, time1) {}
-
-	bvh_node(const std::vector<shared_ptr<hitable>>& src_objects, size_t start, size_t end, double time0, double time1)
-	{
-		auto objects = src_objects; // Create a modifiable array of the source scene objects
-		int axis = random_int(0, 2);
-		auto comparator = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
-		size_t object_span = end - start;
-		if (object_span == 1)
-			left = right = objects[start];
-		else if (object_span == 2)
+	size_t object_span = end - start;
+	if (object_span == 1)
+		return false;
+
+	aabb centroid_bounds(prims[start].centroid, prims[start].centroid);
+	for (size_t i = start + 1; i < end; i++)
+		centroid_bounds = surrounding_box(centroid_bounds, aabb(prims[i].centroid, prims[i].centroid));
+
+	const int nbuckets = std::max(2, options.sah_buckets);
+	std::vector<size_t> count(nbuckets);
+	std::vector<aabb> bucket_box(nbuckets);
+	std::vector<double> right_area(nbuckets);
+	std::vector<size_t> right_count(nbuckets);
+
+	double best_cost = infinity;
+	int best_axis = -1, best_bucket = 0;
+	for (int a = 0; a < 3; a++)
+	{
+		double cmin = centroid_bounds.min()[a];
+		double extent = centroid_bounds.max()[a] - cmin;
+		if (extent <= 0)
+			continue;
+
+		std::fill(count.begin(), count.end(), 0);
+		for (size_t i = start; i < end; i++)
 		{
-			if (comparator(objects[start], objects[start + 1]))
+			int k = bucket_index(prims[i].centroid[a], cmin, extent, nbuckets);
+			bucket_box[k] = count[k]++ ? surrounding_box(bucket_box[k], prims[i].box) : prims[i].box;
+		}
+
+		// Sweep from the right to get the area and count of every right-hand side
+		aabb acc;
+		size_t n = 0;
+		for (int k = nbuckets - 1; k > 0; k--)
+		{
+			if (count[k])
+			{
+				acc = n ? surrounding_box(acc, bucket_box[k]) : bucket_box[k];
+				n += count[k];
+			}
+			right_area[k] = n ? acc.surface_area() : 0;
+			right_count[k] = n;
+		}
+
+		// Sweep from the left and evaluate the split after every bucket
+		n = 0;
+		for (int k = 0; k < nbuckets - 1; k++)
+		{
+			if (count[k])
 			{
-				left = objects[start];
-				right = objects[start + 1];
+				acc = n ? surrounding_box(acc, bucket_box[k]) : bucket_box[k];
+				n += count[k];
 			}
-			else
+			if (n == 0 || right_count[k + 1] == 0)
+				continue;
+			double cost = n * acc.surface_area() + right_count[k + 1] * right_area[k + 1];
+			if (cost < best_cost)
 			{
-				left = objects[start + 1];
-				right = objects[start];
+				best_cost = cost;
+				best_axis = a;
+				best_bucket = k;
 			}
 		}
-		else
+	}
+
+	double leaf_cost = options.intersection_cost * object_span;
+	if (best_axis < 0)
+	{
+		// All centroids coincide: no bucket split exists, so fall back to the count median
+		if (object_span <= static_cast<size_t>(options.max_leaf_size))
+			return false;
+		mid = start + object_span / 2;
+		axis = 0;
+		return true;
+	}
+
+	double area = bounds.surface_area();
+	double split_cost = options.traversal_cost
+		+ options.intersection_cost * (area > 0 ? best_cost / area : object_span);
+	if (object_span <= static_cast<size_t>(options.max_leaf_size) && leaf_cost <= split_cost)
+		return false;
+
+	double cmin = centroid_bounds.min()[best_axis];
+	double extent = centroid_bounds.max()[best_axis] - cmin;
+	auto pivot = std::partition(prims.begin() + start, prims.begin() + end,
+		[&](const bvh_primitive& p)
 		{
-			std::sort(objects.begin() + start, objects.begin() + end, comparator);
-			auto mid = start + object_span / 2;
-			left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-			right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+			return bucket_index(p.centroid[best_axis], cmin, extent, nbuckets) <= best_bucket;
+		});
+	mid = pivot - prims.begin();
+	axis = best_axis;
+	return true;
+}
+
+// Levels a count-median split of n objects needs to reach single-object leaves
+inline int balanced_depth(size_t n)
+{
+	int d = 0;
+	while ((static_cast<size_t>(1) << d) < n)
+		d++;
+	return d;
+}
+
+inline int longest_axis(const aabb& box)
+{
+	vec3 extent = box.max() - box.min();
+	return extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+}
+
+// Splits prims[start, end) at the object-count median along the longest axis of the centroids.
+// Used where a subtree would otherwise grow deeper than bvh_max_depth; false if it fits one leaf.
+inline bool balanced_split(std::vector<bvh_primitive>& prims, size_t start, size_t end, const bvh_build_options& options,
+	size_t& mid, int& axis)
+{
+	size_t object_span = end - start;
+	if (object_span <= static_cast<size_t>(options.max_leaf_size))
+		return false;
+	aabb centroid_bounds(prims[start].centroid, prims[start].centroid);
+	for (size_t i = start + 1; i < end; i++)
+		centroid_bounds = surrounding_box(centroid_bounds, aabb(prims[i].centroid, prims[i].centroid));
+	axis = longest_axis(centroid_bounds);
+	mid = start + object_span / 2;
+	const int a = axis;
+	std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+		[a](const bvh_primitive& p, const bvh_primitive& q) { return p.centroid[a] < q.centroid[a]; });
+	return true;
+}
+
+// Splits prims[start, end) at the object-count median along a random axis.
+inline bool median_split(std::vector<bvh_primitive>& prims, size_t start, size_t end, size_t& mid, int& axis)
+{
+	size_t object_span = end - start;
+	if (object_span == 1)
+		return false;
+	axis = random_int(0, 2);
+	mid = start + object_span / 2;
+	std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+		[axis](const bvh_primitive& a, const bvh_primitive& b) { return a.centroid[axis] < b.centroid[axis]; });
+	return true;
+}
+
+// Builds the binary split hierarchy shared by all BVH layouts. The build permutes one array of
+// primitive records in place and, with OpenMP, recurses into large subtrees as tasks.
+class bvh_builder
+{
+public:
+	bvh_builder(const std::vector<shared_ptr<hitable>>& objects, double time0, double time1,
+		const bvh_build_options& options = bvh_build_options())
+		: options(options)
+	{
+		this->options.max_leaf_size = std::min(std::max(options.max_leaf_size, 1), bvh_max_leaf_size);
+		auto start_time = std::chrono::steady_clock::now();
+		prims.resize(objects.size());
+		const long long n = static_cast<long long>(objects.size());
+#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < n; i++)
+		{
+			prims[i].box = object_box(objects[i], time0, time1);
+			prims[i].centroid = prims[i].box.centroid();
+			prims[i].index = static_cast<size_t>(i);
+		}
+
+		if (!prims.empty() && options.split_method == bvh_split_method::lbvh)
+			build_lbvh();
+		else if (!prims.empty())
+		{
+#pragma omp parallel
+#pragma omp single
+			root = build(0, prims.size(), 0);
 		}
-		aabb box_left, box_right;
-		if (!left->bounding_box(time0, time1, box_left) || !right->bounding_box(time0, time1, box_right))
-			std::cerr << "No bounding box in bvh_node constructor.\n";
-		box = surrounding_box(box_left, box_right);
+		if (root)
+			max_depth = subtree_depth(*root);
+
+		ordered.reserve(prims.size());
+		for (const auto& p : prims)
+			ordered.push_back(objects[p.index]);
+		build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	}
+
+public:
+	std::unique_ptr<bvh_build_node> root;
+	std::vector<shared_ptr<hitable>> ordered;	// source objects in leaf order
+	double build_seconds;
+	int max_depth = 0;	// levels below the root, never more than bvh_max_depth
+
+private:
+	static int subtree_depth(const bvh_build_node& node)
+	{
+		return node.is_leaf() ? 0 : 1 + std::max(subtree_depth(*node.children[0]), subtree_depth(*node.children[1]));
+	}
+
+	// A node at depth may split freely only if a balanced tree still fits below its children;
+	// deeper down the rest of the subtree is built by count medians.
+	static bool depth_allows_any_split(int depth, size_t span)
+	{
+		return depth + 1 + balanced_depth(span) <= bvh_max_depth;
+	}
+
+	std::unique_ptr<bvh_build_node> build(size_t start, size_t end, int depth)
+	{
+		std::unique_ptr<bvh_build_node> node(new bvh_build_node());
+		node->start = start;
+		node->end = end;
+		node->box = prims[start].box;
+		for (size_t i = start + 1; i < end; i++)
+			node->box = surrounding_box(node->box, prims[i].box);
+
+		size_t mid;
+		bool split = !depth_allows_any_split(depth, end - start)
+			? balanced_split(prims, start, end, options, mid, node->axis)
+			: options.split_method == bvh_split_method::sah
+			? sah_split(prims, start, end, node->box, options, mid, node->axis)
+			: median_split(prims, start, end, mid, node->axis);
+		if (!split)
+			return node;
+
+		// random_median draws from the calling thread's generator, so it builds serially to stay reproducible
+		bool spawn = options.split_method == bvh_split_method::sah && end - start >= options.parallel_threshold;
+		bvh_build_node* n = node.get();
+#pragma omp task if(spawn) shared(n)
+		n->children[0] = build(start, mid, depth + 1);
+		n->children[1] = build(mid, end, depth + 1);
+#pragma omp taskwait
+		return node;
+	}
+
+	// Binary radix tree over the sorted codes (Karras 2012). Internal node i covers a contiguous
+	// range of leaves and is found independently of all others, so the whole pass is parallel.
+	struct radix_node
+	{
+		uint32_t first, last;
+		uint32_t split;	// the left child covers [first, split], the right one [split + 1, last]
+	};
+
+	void build_lbvh()
+	{
+		const long long n = static_cast<long long>(prims.size());
+		aabb centroid_bounds(prims[0].centroid, prims[0].centroid);
+		for (const auto& p : prims)
+			centroid_bounds = surrounding_box(centroid_bounds, aabb(p.centroid, p.centroid));
+		vec3 extent = centroid_bounds.max() - centroid_bounds.min();
+		const int bits = options.morton_bits >= 63 ? 63 : 30;
+
+		std::vector<morton_primitive> codes(prims.size());
+#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < n; i++)
+		{
+			vec3 c = prims[i].centroid - centroid_bounds.min();
+			codes[i].code = morton_encode(
+				extent.x() > 0 ? c.x() / extent.x() : 0,
+				extent.y() > 0 ? c.y() / extent.y() : 0,
+				extent.z() > 0 ? c.z() / extent.z() : 0, bits);
+			codes[i].index = static_cast<uint32_t>(i);
+		}
+		radix_sort(codes, bits);
+
+		std::vector<bvh_primitive> sorted(prims.size());
+#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < n; i++)
+			sorted[i] = prims[codes[i].index];
+		prims.swap(sorted);
+
+		std::vector<radix_node> internal(n > 1 ? n - 1 : 0);
+#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < n - 1; i++)
+			internal[i] = radix_split(codes, static_cast<int>(i));
+
+		root = n > 1 ? emit_lbvh(internal, 0, 0) : leaf(0, 1);
+	}
+
+	// Length of the common prefix of keys i and j, with the index breaking ties between equal codes.
+	// Runs of equal codes and codes that differ one bit at a time can make the radix tree up to
+	// 95 levels deep, which emit_lbvh caps at bvh_max_depth.
+	static int common_prefix(const std::vector<morton_primitive>& codes, int i, int j)
+	{
+		if (j < 0 || j >= static_cast<int>(codes.size()))
+			return -1;
+		uint64_t x = codes[i].code ^ codes[j].code;
+		if (x == 0)
+			return 64 + count_leading_zeros64(static_cast<uint64_t>(i ^ j)) - 32;
+		return count_leading_zeros64(x);
+	}
+
+	static radix_node radix_split(const std::vector<morton_primitive>& codes, int i)
+	{
+		// Direction of the range, then its other end by exponential and binary search
+		int d = common_prefix(codes, i, i + 1) - common_prefix(codes, i, i - 1) > 0 ? 1 : -1;
+		int min_prefix = common_prefix(codes, i, i - d);
+		int max_length = 2;
+		while (common_prefix(codes, i, i + max_length * d) > min_prefix)
+			max_length *= 2;
+		int length = 0;
+		for (int t = max_length / 2; t >= 1; t /= 2)
+			if (common_prefix(codes, i, i + (length + t) * d) > min_prefix)
+				length += t;
+		int j = i + length * d;
+
+		// Split where the common prefix of the range first changes
+		int node_prefix = common_prefix(codes, i, j);
+		int s = 0;
+		for (int t = (length + 1) / 2; ; t = (t + 1) / 2)
+		{
+			if (s + t < length + 1 && common_prefix(codes, i, i + (s + t) * d) > node_prefix)
+				s += t;
+			if (t == 1)
+				break;
+		}
+		radix_node node;
+		node.first = static_cast<uint32_t>(std::min(i, j));
+		node.last = static_cast<uint32_t>(std::max(i, j));
+		node.split = static_cast<uint32_t>(i + s * d + std::min(d, 0));
+		return node;
+	}
+
+	std::unique_ptr<bvh_build_node> leaf(size_t start, size_t end) const
+	{
+		std::unique_ptr<bvh_build_node> node(new bvh_build_node());
+		node->start = start;
+		node->end = end;
+		node->box = prims[start].box;
+		for (size_t i = start + 1; i < end; i++)
+			node->box = surrounding_box(node->box, prims[i].box);
+		return node;
+	}
+
+	// Splits the sorted prims[start, end) in the middle down to leaves of at most max_leaf_size objects
+	std::unique_ptr<bvh_build_node> balanced_lbvh(size_t start, size_t end) const
+	{
+		if (end - start <= static_cast<size_t>(options.max_leaf_size))
+			return leaf(start, end);
+		std::unique_ptr<bvh_build_node> node(new bvh_build_node());
+		node->start = start;
+		node->end = end;
+		size_t mid = start + (end - start) / 2;
+		node->children[0] = balanced_lbvh(start, mid);
+		node->children[1] = balanced_lbvh(mid, end);
+		node->box = surrounding_box(node->children[0]->box, node->children[1]->box);
+		node->axis = longest_axis(node->box);
+		return node;
+	}
+
+	// Converts the radix tree into build nodes, turning subtrees of at most max_leaf_size objects into leaves.
+	std::unique_ptr<bvh_build_node> emit_lbvh(const std::vector<radix_node>& internal, uint32_t i, int depth) const
+	{
+		const radix_node& r = internal[i];
+		if (r.last - r.first + 1 <= static_cast<uint32_t>(options.max_leaf_size))
+			return leaf(r.first, r.last + 1);
+		if (!depth_allows_any_split(depth, r.last - r.first + 1))
+			return balanced_lbvh(r.first, r.last + 1);
+
+		std::unique_ptr<bvh_build_node> node(new bvh_build_node());
+		node->start = r.first;
+		node->end = r.last + 1;
+		node->children[0] = r.split == r.first ? leaf(r.split, r.split + 1) : emit_lbvh(internal, r.split, depth + 1);
+		node->children[1] = r.split + 1 == r.last ? leaf(r.last, r.last + 1) : emit_lbvh(internal, r.split + 1, depth + 1);
+		node->box = surrounding_box(node->children[0]->box, node->children[1]->box);
+		node->axis = longest_axis(node->box);
+		return node;
+	}
+
+	std::vector<bvh_primitive> prims;
+	bvh_build_options options;
+};
+
+class bvh_node : public hitable
+{
+public:
+	bvh_node() = delete;
+	bvh_node(const hitable_list& list, double time0, double time1, const bvh_build_options& options = bvh_build_options())
+		: bvh_node(list.objects, 0, list.objects.size(), time0, time1, options) {}
+
+	bvh_node(const std::vector<shared_ptr<hitable>>& src_objects, size_t start, size_t end, double time0, double time1,
+		const bvh_build_options& options = bvh_build_options())
+	{
+		bvh_builder builder(std::vector<shared_ptr<hitable>>(src_objects.begin() + start, src_objects.begin() + end),
+			time0, time1, options);
+		owned = std::move(builder.ordered);
+		assign(*builder.root, owned);
+	}
+
+	bvh_node(const bvh_build_node& node, const std::vector<shared_ptr<hitable>>& ordered)
+	{
+		assign(node, ordered);
 	}
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
 	{
 		if (!box.hit(r, t_min, t_max))
 			return false;
+		if (!prims.empty())
+		{
+			bool hit_anything = false;
+			for (const auto& object : prims)
+				if (object->hit(r, t_min, t_max, rec))
+				{
+					hit_anything = true;
+					t_max = rec.t;
+				}
+			return hit_anything;
+		}
 		bool hit_left = left->hit(r, t_min, t_max, rec);
 		bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
 		return hit_left || hit_right;
 	}
 
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		if (!box.hit(r, t_min, t_max))
+			return false;
+		if (!prims.empty())
+		{
+			for (const auto& object : prims)
+				if (object->occluded(r, t_min, t_max))
+					return true;
+			return false;
+		}
+		return left->occluded(r, t_min, t_max) || right->occluded(r, t_min, t_max);
+	}
+
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
 	{
 		output_box = box;
 		return true;
 	}
 
+private:
+	void assign(const bvh_build_node& node, const std::vector<shared_ptr<hitable>>& ordered)
+	{
+		box = node.box;
+		if (node.is_leaf())
+		{
+			for (size_t i = node.start; i < node.end; i++)
+				prims.push_back(ordered[i].get());
+			return;
+		}
+		left = std::unique_ptr<bvh_node>(new bvh_node(*node.children[0], ordered));
+		right = std::unique_ptr<bvh_node>(new bvh_node(*node.children[1], ordered));
+	}
+
 public:
-	shared_ptr<hitable> left;
-	shared_ptr<hitable> right;
+	// The root owns the primitives and every node owns its children outright, so traversal
+	// only follows plain pointers and never touches a reference count.
+	std::unique_ptr<bvh_node> left;
+	std::unique_ptr<bvh_node> right;
+	std::vector<const hitable*> prims; // objects of a leaf; empty for interior nodes
+	std::vector<shared_ptr<hitable>> owned; // root only
 	aabb box;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,7 @@
 #include "rtweekend.h"
 #include "vec3.h"
 #include "ray.h"
+#include "sampler.h"
 
 class camera
 {
@@ -36,11 +37,14 @@ public:
 		time1 = _time1;
 	}
 
-	ray get_ray(double s, double t) const
+	// The lens position takes the next 2D sample and the shutter time the 1D one after it
+	ray get_ray(double s, double t, sampler& smp) const
 	{
-		vec3 rd = lens_radius * random_in_unit_disk();
+		point2 lens = smp.get_2d();
+		vec3 rd = lens_radius * random_in_unit_disk(lens.x, lens.y);
 		vec3 offset = u * rd.x() + v * rd.y();
-		return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, random_double(time0, time1));
+		double time = time0 + (time1 - time0) * smp.get_1d();
+		return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, time);
 	}
 
 private:
@@ -54,4 +58,41 @@ private:
 };
 
 
+// A viewer's edits to a scene's camera: an orbit around lookat and a dolly towards it
+struct camera_orbit
+{
+	double yaw = 0;		// radians around vup
+	double pitch = 0;	// radians added to the elevation above the plane normal to vup
+	double dolly = 1;	// distance to lookat as a fraction of the scene's
+};
+
+// Orbits stop this short of vup so the view never flips
+const double max_orbit_elevation = 0.49 * pi;
+
+// Angle of lookfrom above the plane through lookat normal to vup
+inline double camera_elevation(const point3& lookfrom, const point3& lookat, const vec3& vup)
+{
+	vec3 offset = lookfrom - lookat;
+	double distance = offset.length();
+	return distance > 0 ? asin(clamp(dot(offset, unit_vector(vup)) / distance, -1.0, 1.0)) : 0;
+}
+
+// Where lookfrom ends up after orbit, with the elevation kept within max_orbit_elevation
+inline point3 orbit_lookfrom(const point3& lookfrom, const point3& lookat, const vec3& vup, const camera_orbit& orbit)
+{
+	vec3 offset = lookfrom - lookat;
+	double distance = offset.length();
+	if (distance <= 0 || (orbit.yaw == 0 && orbit.pitch == 0 && orbit.dolly == 1))
+		return lookfrom;
+	vec3 up = unit_vector(vup);
+	vec3 level = offset - dot(offset, up) * up;
+	if (level.length_squared() < 1e-12 * distance * distance)
+		level = fabs(up.x()) < 0.9 ? cross(up, vec3(1, 0, 0)) : cross(up, vec3(0, 1, 0));
+	vec3 a = unit_vector(level);
+	vec3 b = cross(up, a);
+	double elevation = clamp(camera_elevation(lookfrom, lookat, vup) + orbit.pitch, -max_orbit_elevation, max_orbit_elevation);
+	vec3 direction = cos(elevation) * (cos(orbit.yaw) * a + sin(orbit.yaw) * b) + sin(elevation) * up;
+	return lookat + distance * orbit.dolly * direction;
+}
+
 #endif // !CAMERA_H
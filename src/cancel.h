@@ -0,0 +1,47 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <atomic>
+#include <chrono>
+
+// Cooperative cancellation of a render. Whoever started the render calls cancel(), and the render
+// threads poll the token before taking each tile and before each pixel, so a render stops after
+// the pixel in flight.
+// A token can also run out at a deadline, which is how a time budget ends a render, and can
+// follow a parent, so a render's own budget still stops when its caller cancels.
+class cancel_token
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	explicit cancel_token(const cancel_token* parent = nullptr) : parent(parent) {}
+	cancel_token(const cancel_token&) = delete;
+	cancel_token& operator=(const cancel_token&) = delete;
+
+	void cancel() { flag.store(true, std::memory_order_relaxed); }
+	// Readies the token for another render
+	void reset() { flag.store(false, std::memory_order_relaxed); }
+	// Must be set before the render starts
+	void set_deadline(clock::time_point when) { deadline = when; }
+
+	// Cancelled here or in a parent; a passed deadline does not count
+	bool cancelled() const
+	{
+		return flag.load(std::memory_order_relaxed) || (parent && parent->cancelled());
+	}
+
+	// Cancelled, or out of time here or in a parent
+	bool stop_requested() const
+	{
+		return flag.load(std::memory_order_relaxed)
+			|| (deadline != clock::time_point::max() && clock::now() >= deadline)
+			|| (parent && parent->stop_requested());
+	}
+
+private:
+	std::atomic<bool> flag{ false };
+	const cancel_token* parent;
+	clock::time_point deadline = clock::time_point::max();
+};
+
+#endif // !CANCEL_H
@@ -0,0 +1,216 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "adaptive.h"
+#include "camera.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct checkpoint_settings
+{
+	std::string path;		// where the render's progress is saved; empty for no checkpoints
+	double interval = 300;	// seconds between checkpoints, taken at the end of a pass
+	bool resume = false;	// continue from the checkpoint at path instead of starting afresh
+};
+
+// Everything a render needs to carry on where it stopped. A sample is fixed by the seed, its
+// pixel and its index, which also seed the thread generator and the sampler, so the per-pixel
+// estimates and their sample counts are the whole random state. The first group of fields must
+// match for a checkpoint to be resumed: they decide what the samples are.
+struct render_checkpoint
+{
+	std::string scene;
+	int width = 0, height = 0, tile_size = 0;
+	int samples_per_pixel = 0;
+	uint64_t seed = 0;
+	int sampling = 0;
+	int max_depth = 0, rr_min_bounces = 0;
+	camera_orbit orbit;
+
+	int pass_begin = 0;
+	int passes = 0;
+	std::vector<char> tile_done;
+	std::vector<pixel_estimate> estimates;
+
+	// Reports the first field that differs from other's
+	bool same_samples(const render_checkpoint& other, std::ostream& err) const
+	{
+		const char* field = scene != other.scene ? "scene"
+			: width != other.width || height != other.height ? "image size"
+			: tile_size != other.tile_size ? "tile size"
+			: samples_per_pixel != other.samples_per_pixel ? "samples per pixel"
+			: seed != other.seed ? "seed"
+			: sampling != other.sampling ? "sampler"
+			: max_depth != other.max_depth || rr_min_bounces != other.rr_min_bounces ? "path depth"
+			: orbit.yaw != other.orbit.yaw || orbit.pitch != other.orbit.pitch || orbit.dolly != other.orbit.dolly ? "camera"
+			: nullptr;
+		if (field)
+			err << "Error: the checkpoint was rendered with a different " << field << std::endl;
+		return field == nullptr;
+	}
+};
+
+// The file is a magic number and version, the fields in declaration order and then the two
+// arrays, all in the host's byte order. The estimates keep their doubles, so a resumed render
+// adds to exactly the sums it left off with.
+static const char checkpoint_magic[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '0', '2' };
+
+template <typename T>
+inline bool write_pod(FILE* file, const T* data, size_t count = 1)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "only raw bytes are written");
+	return fwrite(data, sizeof(T), count, file) == count;
+}
+
+template <typename T>
+inline bool read_pod(FILE* file, T* data, size_t count = 1)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "only raw bytes are read");
+	return fread(data, sizeof(T), count, file) == count;
+}
+
+// Writes next to path and renames over it, so a crash mid-write leaves the last checkpoint intact
+inline bool save_checkpoint(const std::string& path, const render_checkpoint& cp)
+{
+	const std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+	const uint32_t name_length = static_cast<uint32_t>(cp.scene.size());
+	const uint64_t tiles = cp.tile_done.size(), pixels = cp.estimates.size();
+	bool ok = write_pod(file, checkpoint_magic, sizeof(checkpoint_magic))
+		&& write_pod(file, &name_length) && write_pod(file, cp.scene.data(), name_length)
+		&& write_pod(file, &cp.width) && write_pod(file, &cp.height) && write_pod(file, &cp.tile_size)
+		&& write_pod(file, &cp.samples_per_pixel) && write_pod(file, &cp.seed) && write_pod(file, &cp.sampling)
+		&& write_pod(file, &cp.max_depth) && write_pod(file, &cp.rr_min_bounces) && write_pod(file, &cp.orbit)
+		&& write_pod(file, &cp.pass_begin) && write_pod(file, &cp.passes)
+		&& write_pod(file, &tiles) && write_pod(file, cp.tile_done.data(), cp.tile_done.size())
+		&& write_pod(file, &pixels) && write_pod(file, cp.estimates.data(), cp.estimates.size());
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(path.c_str());	// rename does not replace an existing file on Windows
+#endif
+	return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+inline bool load_checkpoint(const std::string& path, render_checkpoint& cp)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+	char magic[sizeof(checkpoint_magic)];
+	uint32_t name_length = 0;
+	uint64_t tiles = 0, pixels = 0;
+	bool ok = read_pod(file, magic, sizeof(magic)) && memcmp(magic, checkpoint_magic, sizeof(magic)) == 0
+		&& read_pod(file, &name_length) && name_length < 4096;
+	if (ok)
+	{
+		cp.scene.resize(name_length);
+		ok = read_pod(file, &cp.scene[0], name_length)
+			&& read_pod(file, &cp.width) && read_pod(file, &cp.height) && read_pod(file, &cp.tile_size)
+			&& read_pod(file, &cp.samples_per_pixel) && read_pod(file, &cp.seed) && read_pod(file, &cp.sampling)
+			&& read_pod(file, &cp.max_depth) && read_pod(file, &cp.rr_min_bounces) && read_pod(file, &cp.orbit)
+			&& read_pod(file, &cp.pass_begin) && read_pod(file, &cp.passes)
+			&& cp.width > 0 && cp.height > 0 && cp.width <= (1 << 16) && cp.height <= (1 << 16) && cp.tile_size > 0;
+	}
+	if (ok)
+	{
+		const uint64_t expected_tiles = static_cast<uint64_t>((cp.width + cp.tile_size - 1) / cp.tile_size)
+			* ((cp.height + cp.tile_size - 1) / cp.tile_size);
+		ok = read_pod(file, &tiles) && tiles == expected_tiles;
+		if (ok)
+		{
+			cp.tile_done.resize(tiles);
+			ok = read_pod(file, cp.tile_done.data(), cp.tile_done.size())
+				&& read_pod(file, &pixels) && pixels == static_cast<uint64_t>(cp.width) * cp.height;
+		}
+		if (ok)
+		{
+			cp.estimates.resize(pixels);
+			ok = read_pod(file, cp.estimates.data(), cp.estimates.size());
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+// Saves checkpoints on a thread of its own, so the render only pays for copying its state.
+// While one is being written a newer one waits in its place, and any older waiting one is
+// dropped: only the latest progress matters. The destructor waits until the last is saved.
+class checkpoint_writer
+{
+public:
+	explicit checkpoint_writer(const std::string& path) : path(path), worker(&checkpoint_writer::run, this) {}
+
+	~checkpoint_writer()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+
+	checkpoint_writer(const checkpoint_writer&) = delete;
+	checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+	void submit(std::unique_ptr<render_checkpoint> cp)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			waiting = std::move(cp);
+		}
+		wake.notify_one();
+	}
+
+	// True while a checkpoint is waiting or being written; a caller can skip taking another
+	bool busy()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return writing || waiting != nullptr;
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;)
+		{
+			wake.wait(guard, [this] { return stopping || waiting != nullptr; });
+			if (!waiting)
+				return;
+			std::unique_ptr<render_checkpoint> cp = std::move(waiting);
+			writing = true;
+			guard.unlock();
+			if (!save_checkpoint(path, *cp))
+				std::cerr << "Error: failed to write the checkpoint " << path << std::endl;
+			guard.lock();
+			writing = false;
+		}
+	}
+
+	std::string path;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::unique_ptr<render_checkpoint> waiting;
+	bool writing = false;
+	bool stopping = false;
+	std::thread worker;		// last, so it starts once the rest is constructed
+};
+
+#endif // !CHECKPOINT_H
@@ -0,0 +1,195 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include "renderer.h"
+#include "scenes.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+enum class cli_action
+{
+	render,
+	exit_success,	// help or the scene list was printed
+	exit_failure
+};
+
+// Where and how the headless renderer writes its image
+struct output_settings
+{
+	std::string path = "render.ppm";
+	bool exr_float = false;		// .exr files get 32-bit floats instead of halves
+};
+
+inline void print_usage(const char* program, bool with_output, std::ostream& out)
+{
+	out << "Usage: " << program << " [options]" << std::endl
+		<< "  --scene NAME       scene name or number (see --list-scenes)" << std::endl
+		<< "  --width W          image width in pixels" << std::endl
+		<< "  --height H         image height in pixels (default: 16:9 of the width)" << std::endl
+		<< "  --spp N            samples per pixel, the most per pixel when adaptive (default: the scene's own)" << std::endl
+		<< "  --adaptive         stop sampling tiles once their noise is low enough" << std::endl
+		<< "  --threshold E      relative error at which adaptive sampling stops a tile (implies --adaptive)" << std::endl
+		<< "  --min-spp N        samples before adaptive sampling checks a tile (implies --adaptive)" << std::endl
+		<< "  --depth D          maximum path depth" << std::endl
+		<< "  --threads N        render threads (default: all cores)" << std::endl
+		<< "  --seed S           random seed" << std::endl
+		<< "  --time-budget T    render for T seconds instead of a fixed spp" << std::endl;
+	if (with_output)
+		out << "  --output PATH      where to write the image (.ppm, .png, .pfm or .exr)" << std::endl
+			<< "  --exr-float        write .exr images with 32-bit instead of 16-bit floats" << std::endl
+			<< "  --checkpoint PATH  save the render's progress to PATH as it runs" << std::endl
+			<< "  --checkpoint-interval T  seconds between checkpoints (default: 300)" << std::endl
+			<< "  --resume PATH      continue the render saved in PATH, and keep saving to it" << std::endl;
+	out << "  --list-scenes      print the scene names and exit" << std::endl
+		<< "  --help             print this message and exit" << std::endl;
+}
+
+// Reads a whole argument as a number within [min, max].
+inline bool parse_number(const char* text, double min, double max, double& value)
+{
+	char* end = nullptr;
+	errno = 0;
+	value = strtod(text, &end);
+	return end != text && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+inline bool parse_integer(const char* text, long long min, long long max, long long& value)
+{
+	char* end = nullptr;
+	errno = 0;
+	value = strtoll(text, &end, 10);
+	return end != text && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+// Parses the options shared by the viewer and the headless renderer into settings. output is
+// null for front ends that do not write an image, which then reject the output and checkpoint
+// options.
+inline cli_action parse_command_line(int argc, char* argv[], render_settings& settings, output_settings* output)
+{
+	bool height_given = false;
+	for (int k = 1; k < argc; k++)
+	{
+		const std::string option = argv[k];
+		if (option == "--help" || option == "-h")
+		{
+			print_usage(argv[0], output != nullptr, std::cout);
+			return cli_action::exit_success;
+		}
+		if (option == "--list-scenes")
+		{
+			const auto& scenes = scene_registry();
+			for (size_t i = 0; i < scenes.size(); i++)
+				std::cout << i + 1 << "  " << scenes[i].name << std::endl;
+			return cli_action::exit_success;
+		}
+		if (option == "--adaptive")
+		{
+			settings.adaptive.enabled = true;
+			continue;
+		}
+		if (option == "--exr-float" && output)
+		{
+			output->exr_float = true;
+			continue;
+		}
+		if (k + 1 >= argc)
+		{
+			std::cerr << "Error: " << (option.compare(0, 2, "--") == 0 ? "missing value for " : "unknown option ") << option << std::endl;
+			print_usage(argv[0], output != nullptr, std::cerr);
+			return cli_action::exit_failure;
+		}
+		const char* value = argv[++k];
+		long long integer = 0;
+		double number = 0;
+		bool valid = true;
+		if (option == "--scene")
+		{
+			valid = find_scene(value) >= 0;
+			if (valid)
+				settings.scene = scene_registry()[find_scene(value)].name;
+		}
+		else if (option == "--width")
+		{
+			valid = parse_integer(value, 2, 1 << 16, integer);
+			settings.image_width = static_cast<int>(integer);
+		}
+		else if (option == "--height")
+		{
+			valid = parse_integer(value, 2, 1 << 16, integer);
+			settings.image_height = static_cast<int>(integer);
+			height_given = true;
+		}
+		else if (option == "--spp")
+		{
+			valid = parse_integer(value, 1, 1 << 30, integer);
+			settings.samples_per_pixel = static_cast<int>(integer);
+		}
+		else if (option == "--threshold")
+		{
+			valid = parse_number(value, 0, 1e9, number) && number > 0;
+			settings.adaptive.error_threshold = number;
+			settings.adaptive.enabled = true;
+		}
+		else if (option == "--min-spp")
+		{
+			valid = parse_integer(value, 1, 1 << 30, integer);
+			settings.adaptive.min_spp = static_cast<int>(integer);
+			settings.adaptive.enabled = true;
+		}
+		else if (option == "--depth")
+		{
+			valid = parse_integer(value, 1, 1 << 20, integer);
+			settings.integrator.max_depth = static_cast<int>(integer);
+		}
+		else if (option == "--threads")
+		{
+			valid = parse_integer(value, 1, 1 << 16, integer);
+			settings.threads = static_cast<int>(integer);
+		}
+		else if (option == "--seed")
+		{
+			char* end = nullptr;
+			errno = 0;
+			settings.seed = strtoull(value, &end, 10);
+			valid = end != value && *end == '\0' && errno == 0 && value[0] != '-';
+		}
+		else if (option == "--time-budget")
+		{
+			valid = parse_number(value, 0, 1e9, number) && number > 0;
+			settings.progressive.time_budget = number;
+		}
+		else if (option == "--output" && output)
+			output->path = value;
+		else if (option == "--checkpoint" && output)
+			settings.checkpoint.path = value;
+		else if (option == "--checkpoint-interval" && output)
+		{
+			valid = parse_number(value, 0, 1e9, number);
+			settings.checkpoint.interval = number;
+		}
+		else if (option == "--resume" && output)
+		{
+			settings.checkpoint.path = value;
+			settings.checkpoint.resume = true;
+		}
+		else
+		{
+			std::cerr << "Error: unknown option " << option << std::endl;
+			print_usage(argv[0], output != nullptr, std::cerr);
+			return cli_action::exit_failure;
+		}
+		if (!valid)
+		{
+			std::cerr << "Error: invalid value for " << option << ": " << value << std::endl;
+			return cli_action::exit_failure;
+		}
+	}
+	if (!height_given)
+		settings.image_height = std::max(2, settings.image_width * 9 / 16);
+	return cli_action::render;
+}
+
+#endif // !CLI_H
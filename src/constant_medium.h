@@ -18,6 +18,37 @@ public:
 		// Print occasional samples when debugging. To enable, set enableDebug true.
 		const bool enableDebug = false;
 		const bool debugging = enableDebug && random_double() < 0.00001;
+		if (!sample_scattering(r, t_min, t_max, rec.t, debugging))
+			return false;
+		if (debugging) std::cerr << "rec.t = " << rec.t << '\n';
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
+		rec.p = r.at(rec.t);
+		rec.normal = vec3(1, 0, 0); // arbitrary
+		rec.front_face = true; // also arbitrary
+		rec.mat_ptr = phase_function.get();
+	}
+
+	// A shadow ray is blocked where its sampled free-flight distance ends inside the medium
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		double t;
+		return sample_scattering(r, t_min, t_max, t, false);
+	}
+
+	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	{
+		return boundary->bounding_box(time0, time1, output_box);
+	}
+
+private:
+	// Samples a free-flight distance through the part of the boundary within [t_min, t_max]
+	bool sample_scattering(const ray& r, double t_min, double t_max, double& t, bool debugging) const
+	{
 		hit_record rec1, rec2;
 		if (!boundary->hit(r, -infinity, infinity, rec1))
 			return false;
@@ -36,25 +67,10 @@ public:
 		const auto hit_distance = neg_inv_density * log(random_double());
 		if (hit_distance > distance_inside_boundary)
 			return false;
-		rec.t = rec1.t + hit_distance / ray_length;
-		rec.p = r.at(rec.t);
-		if (debugging) 
-		{
-			std::cerr << "hit_distance = " << hit_distance << '\n'
-				<< "rec.t = " << rec.t << '\n'
-				<< "rec.p = " << rec.p << '\n';
-		}
-		rec.normal = vec3(1, 0, 0); // arbitrary
-		rec.front_face = true; // also arbitrary
-		rec.mat_ptr = phase_function;
+		t = rec1.t + hit_distance / ray_length;
 		return true;
 	}
 
-	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
-	{
-		return boundary->bounding_box(time0, time1, output_box);
-	}
-
 public:
 	shared_ptr<hitable> boundary;
 	shared_ptr<material> phase_function;
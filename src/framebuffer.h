@@ -0,0 +1,149 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "memory.h"
+#include "scheduler.h"
+
+// Multi-producer, single-consumer queue of tile indices that never blocks a producer on the
+// consumer. A tile is in the queue at most once: pushing a tile that is already waiting does
+// nothing, so a ring with a slot per tile can never overflow. Each slot carries a sequence
+// number, as in Vyukov's bounded queue, that tells the consumer when the producer which
+// claimed the slot has finished writing it.
+class dirty_tile_queue
+{
+public:
+	explicit dirty_tile_queue(int tiles) : slots(std::max(tiles, 1)), queued(std::max(tiles, 1))
+	{
+		for (size_t k = 0; k < slots.size(); k++)
+			slots[k].sequence.store(k, std::memory_order_relaxed);
+		for (auto& q : queued)
+			q.store(false, std::memory_order_relaxed);
+	}
+
+	// Called by any thread once the tile's pixels are written. False if the tile was already queued.
+	bool push(int tile)
+	{
+		if (queued[tile].exchange(true, std::memory_order_acq_rel))
+			return false;
+		size_t pos = tail.fetch_add(1, std::memory_order_relaxed);
+		slot& s = slots[pos % slots.size()];
+		// With every queued tile distinct the consumer has already taken this slot's previous
+		// entry; the wait only covers the moment before it marks the slot free.
+		while (s.sequence.load(std::memory_order_acquire) != pos)
+			std::this_thread::yield();
+		s.tile = tile;
+		s.sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Called by the consumer only. The tile is taken off the queue before its pixels are read,
+	// so a write that lands during the read queues it again.
+	bool pop(int& tile)
+	{
+		slot& s = slots[head % slots.size()];
+		if (s.sequence.load(std::memory_order_acquire) != head + 1)
+			return false;
+		tile = s.tile;
+		s.sequence.store(head + slots.size(), std::memory_order_release);
+		head++;
+		queued[tile].exchange(false, std::memory_order_acq_rel);
+		return true;
+	}
+
+	// Consumer only
+	bool empty() const { return slots[head % slots.size()].sequence.load(std::memory_order_acquire) != head + 1; }
+
+private:
+	struct alignas(64) slot
+	{
+		std::atomic<size_t> sequence;
+		int tile = 0;
+	};
+	std::vector<slot, aligned_allocator<slot, 64>> slots;
+	std::vector<std::atomic<bool>> queued;
+	// Padding rather than alignas, which new does not honour before C++17, keeps the producers'
+	// counter off the consumer's cache line
+	char pad0[64];
+	std::atomic<size_t> tail{ 0 };
+	char pad1[64];
+	size_t head = 0;
+};
+
+// The image the render threads share with the viewer: the current estimate of every pixel as
+// linear float RGBA (alpha is 1) in one cache-line-aligned block, row 0 at the bottom, and
+// optionally planes with each pixel's sample count and the variance of its luminance samples.
+// Render threads write a tile and then publish it; the viewer drains the dirty tiles and reads
+// only those. A tile the next pass rewrites while the viewer reads it is published again, so a
+// torn tile shows for one frame at most.
+class framebuffer
+{
+public:
+	framebuffer(int width, int height, int tile_size = tile_settings().size, bool with_counts = false, bool with_variance = false)
+		: grid(width, height, tile_size), dirty(grid.count()),
+		rgba(static_cast<size_t>(width) * height * 4, 0.0f),
+		counts(with_counts ? static_cast<size_t>(width) * height : 0, 0),
+		variances(with_variance ? static_cast<size_t>(width) * height : 0, 0.0f) {}
+
+	int width() const { return grid.width; }
+	int height() const { return grid.height; }
+	const tile_grid& tiles() const { return grid; }
+
+	float* pixel(int x, int y) { return &rgba[(static_cast<size_t>(y) * grid.width + x) * 4]; }
+	const float* pixel(int x, int y) const { return &rgba[(static_cast<size_t>(y) * grid.width + x) * 4]; }
+
+	// Null when the framebuffer was made without the plane
+	uint32_t* sample_counts() { return counts.empty() ? nullptr : counts.data(); }
+	float* variance() { return variances.empty() ? nullptr : variances.data(); }
+
+	// Marks every tile overlapping [x0, x1) x [y0, y1) for the viewer, and wakes it if it waits.
+	// The mutex is only taken when the viewer is asleep.
+	void publish(int x0, int y0, int x1, int y1)
+	{
+		bool pushed = false;
+		for (int ty = y0 / grid.size; ty * grid.size < y1; ty++)
+			for (int tx = x0 / grid.size; tx * grid.size < x1; tx++)
+				pushed |= dirty.push(ty * grid.tiles_x + tx);
+		// Pairs with the fence in wait_dirty: either the viewer sees the tile or this sees it asleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (pushed && sleeping.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> guard(wake_lock);
+			wake.notify_one();
+		}
+	}
+
+	// The next tile changed since it was last taken; a single thread may call this and wait_dirty
+	bool next_dirty(int& tile) { return dirty.pop(tile); }
+
+	// Blocks until a tile is published or the timeout passes; true if a tile is waiting
+	template <typename Rep, typename Period>
+	bool wait_dirty(const std::chrono::duration<Rep, Period>& timeout)
+	{
+		std::unique_lock<std::mutex> lock(wake_lock);
+		sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool ready = wake.wait_for(lock, timeout, [this] { return !dirty.empty(); });
+		sleeping.store(false, std::memory_order_relaxed);
+		return ready;
+	}
+
+private:
+	tile_grid grid;
+	dirty_tile_queue dirty;
+	std::mutex wake_lock;
+	std::condition_variable wake;
+	std::atomic<bool> sleeping{ false };
+	std::vector<float, aligned_allocator<float, 64>> rgba;
+	std::vector<uint32_t, aligned_allocator<uint32_t, 64>> counts;
+	std::vector<float, aligned_allocator<float, 64>> variances;
+};
+
+#endif // !FRAMEBUFFER_H
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "image_writer.h"
+#include "cli.h"
+
+// Batch renderer for machines without a display: renders the scene chosen on the command line,
+// writes it to --output in the format its extension names and reports failure through the
+// exit status.
+int main(int argc, char* argv[])
+{
+	output_settings out;
+	render_settings settings;
+	cli_action action = parse_command_line(argc, argv, settings, &out);
+	const std::string& output = out.path;
+	if (action != cli_action::render)
+		return action == cli_action::exit_success ? 0 : 2;
+
+	image_format format;
+	if (!image_format_from_path(output, format))
+	{
+		std::cerr << "Error: unknown image format for " << output << " (use .ppm, .png, .pfm or .exr)" << std::endl;
+		return 2;
+	}
+	if (format == image_format::exr_half && out.exr_float)
+		format = image_format::exr_float;
+	// Tiles are written to the file as they finish, so no framebuffer is kept besides the estimates
+	std::unique_ptr<image_writer> writer = make_image_writer(format);
+	if (!writer->open(output, settings.image_width, settings.image_height))
+	{
+		std::cerr << "Error: failed to create " << output << std::endl;
+		return 1;
+	}
+	if (!render(settings, nullptr, writer.get()))
+		return 1;
+	if (!writer->close())
+	{
+		std::cerr << "Error: failed to write the image to " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Image written to " << output << std::endl;
+	return 0;
+}
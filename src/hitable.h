@@ -6,12 +6,16 @@
 #include "aabb.h"
 
 class material;
+class hitable;
 
+// hit() only fills t and prim; the remaining attributes are filled by
+// prim->compute_surface_interaction() once the closest hit is known.
 struct hit_record
 {
+	const hitable* prim = nullptr;	// the object that reported the hit
 	point3 p;
 	vec3 normal;
-	shared_ptr<material> mat_ptr;
+	const material* mat_ptr = nullptr;	// owned by the primitive; valid while the scene lives
 	double t;
 	double u, v;
 	bool front_face;
@@ -26,9 +30,19 @@ class hitable
 {
 public:
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+	// Fills p, normal, front_face, u, v and the material of a hit this object reported for r
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const {}
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const = 0;
+	// Any-hit query for shadow rays: whether anything lies along r within [t_min, t_max].
+	// Stops at the first hit found and computes no surface attributes.
+	virtual bool occluded(const ray& r, double t_min, double t_max) const
+	{
+		hit_record rec;
+		return hit(r, t_min, t_max, rec);
+	}
 	virtual double pdf_value(const vec3& o, const vec3& v) const { return 0.0; }
-	virtual vec3 random(const vec3& o) const { return vec3(1, 0, 0); }
+	// Direction from o towards a point on the object, picked by the 2D sample (r1, r2)
+	virtual vec3 random(const vec3& o, double r1, double r2) const { return vec3(1, 0, 0); }
 };
 
 class translate : public hitable
@@ -42,11 +56,21 @@ public:
 		ray moved_r(r.origin() - offset, r.direction(), r.time());
 		if (!ptr->hit(moved_r, t_min, t_max, rec))
 			return false;
+		// The attributes have to be brought out of object space, so instances resolve their hit right away
+		rec.prim->compute_surface_interaction(moved_r, rec);
 		rec.p += offset;
 		rec.set_face_normal(moved_r, rec.normal);
+		rec.prim = this;
 		return true;
 	}
 
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override {}
+
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		return ptr->occluded(ray(r.origin() - offset, r.direction(), r.time()), t_min, t_max);
+	}
+
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
 	{
 		if (!ptr->bounding_box(time0, time1, output_box))
@@ -64,7 +88,7 @@ public:
 class rotate_y : public hitable 
 {
 public:
-	rotate_y::rotate_y(shared_ptr<hitable> p, double angle) : ptr(p) 
+	rotate_y(shared_ptr<hitable> p, double angle) : ptr(p) 
 	{
 		auto radians = degrees_to_radians(angle);
 		sin_theta = sin(radians);
@@ -94,15 +118,10 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
 	{
-		auto origin = r.origin();
-		auto direction = r.direction();
-		origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-		origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
-		direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-		direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
-		ray rotated_r(origin, direction, r.time());
+		ray rotated_r = to_object(r);
 		if (!ptr->hit(rotated_r, t_min, t_max, rec))
 			return false;
+		rec.prim->compute_surface_interaction(rotated_r, rec);
 
 		auto p = rec.p;
 		auto normal = rec.normal;
@@ -112,15 +131,35 @@ public:
 		normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
 		rec.p = p;
 		rec.set_face_normal(rotated_r, normal);
+		rec.prim = this;
 		return true;
 	}
 
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override {}
+
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		return ptr->occluded(to_object(r), t_min, t_max);
+	}
+
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override 
 	{
 		output_box = bbox;
 		return hasbox;
 	}
 
+private:
+	ray to_object(const ray& r) const
+	{
+		auto origin = r.origin();
+		auto direction = r.direction();
+		origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
+		origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
+		direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
+		direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
+		return ray(origin, direction, r.time());
+	}
+
 public:
 	shared_ptr<hitable> ptr;
 	double sin_theta;
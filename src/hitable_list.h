@@ -3,6 +3,7 @@
 
 #include "hitable.h"
 #include "ray.h"
+#include <algorithm>
 #include <vector>
 
 class hitable_list : public hitable
@@ -31,6 +32,14 @@ public:
 		return hit_anything;
 	}
 
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		for (const auto& object : objects)
+			if (object->occluded(r, t_min, t_max))
+				return true;
+		return false;
+	}
+
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
 	{
 		if (objects.empty()) 
@@ -56,10 +65,12 @@ public:
 		return sum;
 	}
 
-	virtual vec3 random(const vec3& o) const override
+	virtual vec3 random(const vec3& o, double r1, double r2) const override
 	{
-		int index = random_double(0, objects.size() - 0.001);
-		return objects[index]->random(o);
+		size_t index = std::min(static_cast<size_t>(r1 * objects.size()), objects.size() - 1);
+		// Stretch what is left of r1 back to [0,1) so the chosen object still gets a stratified sample
+		r1 = r1 * objects.size() - index;
+		return objects[index]->random(o, r1, r2);
 	}
 
 public:
@@ -0,0 +1,455 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class image_format
+{
+	ppm,		// 8-bit, gamma 2
+	png,		// 8-bit, gamma 2
+	pfm,		// linear 32-bit float
+	exr_half,	// linear 16-bit float, uncompressed scanlines
+	exr_float	// linear 32-bit float, uncompressed scanlines
+};
+
+// Picks the format from the file extension; .exr means half floats, and callers that offer
+// full floats switch to exr_float themselves.
+inline bool image_format_from_path(const std::string& path, image_format& format)
+{
+	size_t dot = path.find_last_of('.');
+	std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+	for (auto& c : ext)
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	if (ext == "ppm")
+		format = image_format::ppm;
+	else if (ext == "png")
+		format = image_format::png;
+	else if (ext == "pfm")
+		format = image_format::pfm;
+	else if (ext == "exr")
+		format = image_format::exr_half;
+	else
+		return false;
+	return true;
+}
+
+inline uint16_t float_to_half(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, 4);
+	uint32_t sign = (f >> 16) & 0x8000;
+	int32_t exponent = static_cast<int32_t>((f >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = f & 0x7fffff;
+	if (((f >> 23) & 0xff) == 0xff)		// inf and nan
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)					// too large: inf
+		return static_cast<uint16_t>(sign | 0x7c00);
+	if (exponent <= 0)					// subnormal or zero
+	{
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return static_cast<uint16_t>(sign | half);
+	}
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;		// may carry into the exponent, which rounds up to the next power of two or to inf
+	return static_cast<uint16_t>(half);
+}
+
+inline std::array<uint32_t, 256> make_crc32_table()
+{
+	std::array<uint32_t, 256> table;
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		table[n] = c;
+	}
+	return table;
+}
+
+inline uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t size)
+{
+	static const std::array<uint32_t, 256> table = make_crc32_table();
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+inline unsigned char to_byte_gamma2(double linear)
+{
+	return static_cast<unsigned char>(clamp(sqrt(linear), 0.0, 1.0) * 255);
+}
+
+// Receives tiles of linear radiance as they finish, in any order and from any thread, and
+// writes them straight to their place in the file. Every format here has a fixed layout, so no
+// full-frame copy is ever held in memory. Rows are numbered from the bottom, as on the canvas.
+class image_writer
+{
+public:
+	virtual ~image_writer()
+	{
+		if (file)
+			fclose(file);
+	}
+
+	bool open(const std::string& path, int image_width, int image_height)
+	{
+		width = image_width;
+		height = image_height;
+		file = fopen(path.c_str(), "w+b");
+		if (!file)
+			return false;
+		if (!write_layout() || ferror(file))
+		{
+			fclose(file);
+			file = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	// pixels holds the tile's rows y0..y1-1, each with columns x0..x1-1
+	void write_tile(int x0, int y0, int x1, int y1, const color* pixels)
+	{
+		std::vector<unsigned char> bytes;
+		std::lock_guard<std::mutex> guard(lock);
+		for (int y = y0; y < y1; y++)
+			write_span(y, x0, x1, pixels + static_cast<size_t>(y - y0) * (x1 - x0), bytes);
+	}
+
+	bool close()
+	{
+		if (!file)
+			return false;
+		bool ok = finish() && !ferror(file);
+		ok = fclose(file) == 0 && ok;
+		file = nullptr;
+		return ok;
+	}
+
+protected:
+	// Writes the headers and reserves every pixel's place
+	virtual bool write_layout() = 0;
+	virtual void write_span(int y, int x0, int x1, const color* pixels, std::vector<unsigned char>& bytes) = 0;
+	virtual bool finish() { return true; }
+
+	void seek(uint64_t offset)
+	{
+#ifdef _MSC_VER
+		_fseeki64(file, static_cast<long long>(offset), SEEK_SET);
+#else
+		fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+	}
+
+	void write_at(uint64_t offset, const unsigned char* data, size_t size)
+	{
+		seek(offset);
+		fwrite(data, 1, size, file);
+	}
+
+	void reserve(uint64_t size)
+	{
+		std::vector<unsigned char> zeros(static_cast<size_t>(std::min<uint64_t>(size, 1 << 20)), 0);
+		while (size > 0)
+		{
+			size_t n = static_cast<size_t>(std::min<uint64_t>(size, zeros.size()));
+			fwrite(zeros.data(), 1, n, file);
+			size -= n;
+		}
+	}
+
+	static void put_le32(std::vector<unsigned char>& out, uint32_t v)
+	{
+		for (int k = 0; k < 4; k++)
+			out.push_back(static_cast<unsigned char>(v >> (8 * k)));
+	}
+
+	static void put_be32(std::vector<unsigned char>& out, uint32_t v)
+	{
+		for (int k = 3; k >= 0; k--)
+			out.push_back(static_cast<unsigned char>(v >> (8 * k)));
+	}
+
+	FILE* file = nullptr;
+	int width = 0, height = 0;
+	std::mutex lock;
+};
+
+// Binary PPM, rows from the top
+class ppm_writer : public image_writer
+{
+protected:
+	virtual bool write_layout() override
+	{
+		char header[64];
+		int size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+		data_offset = static_cast<uint64_t>(size);
+		fwrite(header, 1, size, file);
+		reserve(static_cast<uint64_t>(width) * height * 3);
+		return true;
+	}
+
+	virtual void write_span(int y, int x0, int x1, const color* pixels, std::vector<unsigned char>& bytes) override
+	{
+		bytes.clear();
+		for (int x = x0; x < x1; x++)
+			for (int c = 0; c < 3; c++)
+				bytes.push_back(to_byte_gamma2(pixels[x - x0][c]));
+		write_at(data_offset + (static_cast<uint64_t>(height - 1 - y) * width + x0) * 3, bytes.data(), bytes.size());
+	}
+
+	uint64_t data_offset = 0;
+};
+
+// Portable float map: little-endian floats, rows from the bottom
+class pfm_writer : public image_writer
+{
+protected:
+	virtual bool write_layout() override
+	{
+		char header[64];
+		int size = snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+		data_offset = static_cast<uint64_t>(size);
+		fwrite(header, 1, size, file);
+		reserve(static_cast<uint64_t>(width) * height * 12);
+		return true;
+	}
+
+	virtual void write_span(int y, int x0, int x1, const color* pixels, std::vector<unsigned char>& bytes) override
+	{
+		bytes.clear();
+		for (int x = x0; x < x1; x++)
+			for (int c = 0; c < 3; c++)
+			{
+				float v = static_cast<float>(pixels[x - x0][c]);
+				uint32_t bits;
+				memcpy(&bits, &v, 4);
+				put_le32(bytes, bits);
+			}
+		write_at(data_offset + (static_cast<uint64_t>(y) * width + x0) * 12, bytes.data(), bytes.size());
+	}
+
+	uint64_t data_offset = 0;
+};
+
+// OpenEXR scanline image without compression: one line per block, channels B, G, R stored one
+// after the other within a line, rows from the top.
+class exr_writer : public image_writer
+{
+public:
+	explicit exr_writer(bool half) : half(half) {}
+
+protected:
+	virtual bool write_layout() override
+	{
+		std::vector<unsigned char> h = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+		auto attribute = [&](const char* name, const char* type, const std::vector<unsigned char>& value)
+		{
+			h.insert(h.end(), name, name + strlen(name) + 1);
+			h.insert(h.end(), type, type + strlen(type) + 1);
+			put_le32(h, static_cast<uint32_t>(value.size()));
+			h.insert(h.end(), value.begin(), value.end());
+		};
+		std::vector<unsigned char> v;
+		for (const char* name : { "B", "G", "R" })
+		{
+			v.push_back(static_cast<unsigned char>(name[0]));
+			v.push_back(0);
+			put_le32(v, half ? 1 : 2);	// pixel type
+			put_le32(v, 0);				// pLinear and reserved
+			put_le32(v, 1);				// x sampling
+			put_le32(v, 1);				// y sampling
+		}
+		v.push_back(0);
+		attribute("channels", "chlist", v);
+		attribute("compression", "compression", { 0 });
+		v.clear();
+		put_le32(v, 0);
+		put_le32(v, 0);
+		put_le32(v, static_cast<uint32_t>(width - 1));
+		put_le32(v, static_cast<uint32_t>(height - 1));
+		attribute("dataWindow", "box2i", v);
+		attribute("displayWindow", "box2i", v);
+		attribute("lineOrder", "lineOrder", { 0 });
+		v.clear();
+		put_le32(v, 0x3f800000);	// 1.0f
+		attribute("pixelAspectRatio", "float", v);
+		attribute("screenWindowCenter", "v2f", std::vector<unsigned char>(8, 0));
+		attribute("screenWindowWidth", "float", v);
+		h.push_back(0);
+
+		channel_bytes = static_cast<uint64_t>(width) * (half ? 2 : 4);
+		line_bytes = 8 + 3 * channel_bytes;
+		first_line = h.size() + 8 * static_cast<uint64_t>(height);
+		for (int y = 0; y < height; y++)
+		{
+			uint64_t offset = first_line + y * line_bytes;
+			put_le32(h, static_cast<uint32_t>(offset));
+			put_le32(h, static_cast<uint32_t>(offset >> 32));
+		}
+		fwrite(h.data(), 1, h.size(), file);
+		std::vector<unsigned char> line;
+		for (int y = 0; y < height; y++)
+		{
+			line.clear();
+			put_le32(line, static_cast<uint32_t>(y));
+			put_le32(line, static_cast<uint32_t>(3 * channel_bytes));
+			fwrite(line.data(), 1, line.size(), file);
+			reserve(3 * channel_bytes);
+		}
+		return true;
+	}
+
+	virtual void write_span(int y, int x0, int x1, const color* pixels, std::vector<unsigned char>& bytes) override
+	{
+		const uint64_t line = first_line + static_cast<uint64_t>(height - 1 - y) * line_bytes + 8;
+		const int size = half ? 2 : 4;
+		for (int c = 0; c < 3; c++)
+		{
+			bytes.clear();
+			for (int x = x0; x < x1; x++)
+			{
+				float v = static_cast<float>(pixels[x - x0][2 - c]);
+				uint32_t bits;
+				if (half)
+					bits = float_to_half(v);
+				else
+					memcpy(&bits, &v, 4);
+				for (int k = 0; k < size; k++)
+					bytes.push_back(static_cast<unsigned char>(bits >> (8 * k)));
+			}
+			write_at(line + c * channel_bytes + static_cast<uint64_t>(x0) * size, bytes.data(), bytes.size());
+		}
+	}
+
+	bool half;
+	uint64_t channel_bytes = 0, line_bytes = 0, first_line = 0;
+};
+
+// 8-bit RGB PNG. The zlib stream uses stored (uncompressed) deflate blocks, one per row, each in
+// an IDAT chunk of its own, so every pixel has a fixed place. The chunk CRCs and the Adler-32
+// of the stream are filled in by reading the rows back once all tiles are in.
+class png_writer : public image_writer
+{
+protected:
+	virtual bool write_layout() override
+	{
+		row_bytes = 1 + 3 * static_cast<uint64_t>(width);
+		if (row_bytes > 0xffff)
+			return false;	// a row must fit one stored block
+		std::vector<unsigned char> h = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		std::vector<unsigned char> ihdr;
+		put_be32(ihdr, static_cast<uint32_t>(width));
+		put_be32(ihdr, static_cast<uint32_t>(height));
+		ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });
+		chunk(h, "IHDR", ihdr);
+		chunk(h, "IDAT", { 0x78, 0x01 });	// zlib header: deflate, no preset dictionary
+		first_row = h.size();
+		fwrite(h.data(), 1, h.size(), file);
+
+		std::vector<unsigned char> row;
+		for (int r = 0; r < height; r++)
+		{
+			row.clear();
+			put_be32(row, static_cast<uint32_t>(5 + row_bytes));
+			row.insert(row.end(), { 'I', 'D', 'A', 'T' });
+			const uint16_t len = static_cast<uint16_t>(row_bytes);
+			row.insert(row.end(), { 0, static_cast<unsigned char>(len), static_cast<unsigned char>(len >> 8),
+				static_cast<unsigned char>(~len), static_cast<unsigned char>(~len >> 8), 0 });	// block header, filter none
+			fwrite(row.data(), 1, row.size(), file);
+			reserve(row_bytes - 1 + 4);	// pixels and the CRC
+		}
+		return true;
+	}
+
+	virtual void write_span(int y, int x0, int x1, const color* pixels, std::vector<unsigned char>& bytes) override
+	{
+		bytes.clear();
+		for (int x = x0; x < x1; x++)
+			for (int c = 0; c < 3; c++)
+				bytes.push_back(to_byte_gamma2(pixels[x - x0][c]));
+		write_at(row_offset(height - 1 - y) + 8 + 6 + static_cast<uint64_t>(x0) * 3, bytes.data(), bytes.size());
+	}
+
+	virtual bool finish() override
+	{
+		uint32_t a = 1, b = 0;		// Adler-32 of the uncompressed rows
+		std::vector<unsigned char> chunk_data(static_cast<size_t>(4 + 5 + row_bytes));
+		for (int r = 0; r < height; r++)
+		{
+			seek(row_offset(r) + 4);
+			if (fread(chunk_data.data(), 1, chunk_data.size(), file) != chunk_data.size())
+				return false;
+			for (size_t i = 9; i < chunk_data.size(); i++)
+			{
+				a = (a + chunk_data[i]) % 65521;
+				b = (b + a) % 65521;
+			}
+			std::vector<unsigned char> crc;
+			put_be32(crc, crc32_update(0, chunk_data.data(), chunk_data.size()));
+			write_at(row_offset(r) + 4 + chunk_data.size(), crc.data(), crc.size());
+		}
+		std::vector<unsigned char> tail;
+		std::vector<unsigned char> last = { 1, 0, 0, 0xff, 0xff };	// final, empty stored block
+		put_be32(last, (b << 16) | a);
+		chunk(tail, "IDAT", last);
+		chunk(tail, "IEND", {});
+		write_at(row_offset(height), tail.data(), tail.size());
+		return true;
+	}
+
+	uint64_t row_offset(int r) const { return first_row + static_cast<uint64_t>(r) * (12 + 5 + row_bytes); }
+
+	static void chunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+	{
+		put_be32(out, static_cast<uint32_t>(data.size()));
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		put_be32(out, crc32_update(0, out.data() + start, out.size() - start));
+	}
+
+	uint64_t row_bytes = 0, first_row = 0;
+};
+
+inline std::unique_ptr<image_writer> make_image_writer(image_format format)
+{
+	switch (format)
+	{
+	case image_format::ppm:
+		return std::unique_ptr<image_writer>(new ppm_writer());
+	case image_format::png:
+		return std::unique_ptr<image_writer>(new png_writer());
+	case image_format::pfm:
+		return std::unique_ptr<image_writer>(new pfm_writer());
+	case image_format::exr_float:
+		return std::unique_ptr<image_writer>(new exr_writer(false));
+	case image_format::exr_half:
+	default:
+		return std::unique_ptr<image_writer>(new exr_writer(true));
+	}
+}
+
+#endif // !IMAGE_WRITER_H
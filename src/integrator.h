@@ -0,0 +1,148 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include "ray.h"
+#include "hitable.h"
+#include "hitable_list.h"
+#include "material.h"
+#include "pdf.h"
+#include "sampler.h"
+#include "memory.h"
+
+struct integrator_settings
+{
+	int max_depth = 50;			// most surface interactions on one path
+	int rr_min_bounces = 3;		// bounces before Russian roulette may end a path
+};
+
+// What the integrator aims rays at. Emitters get next-event estimation; attractors are objects
+// that do not emit but are worth steering BSDF samples towards, such as glass spheres that
+// focus light onto the surfaces around them.
+struct scene_lights
+{
+	shared_ptr<hitable_list> emitters = make_shared<hitable_list>();
+	shared_ptr<hitable_list> attractors = make_shared<hitable_list>();
+};
+
+inline double power_heuristic(double pdf_a, double pdf_b)
+{
+	double a2 = pdf_a * pdf_a, b2 = pdf_b * pdf_b;
+	return a2 / (a2 + b2);
+}
+
+// Density with which next-event estimation would have sampled the direction of r, counting only
+// the emitters that r hits at distance t.
+inline double emitter_pdf(const hitable_list& emitters, const ray& r, double t)
+{
+	double pdf = 0;
+	for (const auto& light : emitters.objects)
+	{
+		hit_record lrec;
+		if (light->hit(r, 0.001, infinity, lrec) && fabs(lrec.t - t) <= 1e-9 * t)
+			pdf += light->pdf_value(r.origin(), r.direction());
+	}
+	return emitters.objects.empty() ? 0 : pdf / emitters.objects.size();
+}
+
+// Iterative path tracer with next-event estimation. At every diffuse vertex one emitter is
+// sampled and connected with a shadow ray, and the BSDF (optionally mixed with the attractors)
+// samples the continuation; emission found either way is weighted by the power heuristic.
+// The path weight is carried as a throughput, and after rr_min_bounces the path continues from
+// each vertex with a probability equal to the throughput's luminance, with the survivors
+// reweighted so the estimate stays unbiased.
+// The per-bounce pdfs are built in arena, which is reset at the start of every path.
+inline color ray_color(const ray& r_in, const color& background, const hitable& world, const scene_lights& lights,
+	const integrator_settings& settings, sampler& smp, memory_arena& arena)
+{
+	arena.reset();
+	const hitable_list& emitters = *lights.emitters;
+	color radiance(0, 0, 0);
+	color throughput(1, 1, 1);
+	ray r = r_in;
+	bool specular_bounce = true;	// the camera ray counts as specular: nothing could have sampled it
+	double bsdf_pdf = 0;			// density of the BSDF sample that produced r
+	for (int depth = 0; depth < settings.max_depth; depth++)
+	{
+		hit_record hrec;
+		if (!world.hit(r, 0.001, infinity, hrec))
+		{
+			radiance += throughput * background;
+			break;
+		}
+		hrec.prim->compute_surface_interaction(r, hrec);
+
+		color emitted = hrec.mat_ptr->emitted(r, hrec, hrec.u, hrec.v, hrec.p);
+		if (emitted.x() > 0 || emitted.y() > 0 || emitted.z() > 0)
+		{
+			double weight = 1;
+			if (!specular_bounce)
+			{
+				double light_pdf = emitter_pdf(emitters, r, hrec.t);
+				if (light_pdf > 0)
+					weight = power_heuristic(bsdf_pdf, light_pdf);
+			}
+			radiance += weight * throughput * emitted;
+		}
+
+		// Roulette after the emission at this vertex is counted: a path that was just sampled
+		// towards a light has a low throughput but should still collect that light in full.
+		if (depth >= settings.rr_min_bounces)
+		{
+			double survive = fmin(1.0, luminance(throughput));
+			if (smp.get_1d() >= survive)
+				break;
+			throughput = throughput / survive;
+		}
+
+		scatter_record srec;
+		if (!hrec.mat_ptr->scatter(r, hrec, srec, arena))
+			break;
+
+		if (srec.is_specular)
+		{
+			throughput = throughput * srec.attenuation;
+			r = srec.specular_ray;
+			specular_bounce = true;
+			continue;
+		}
+
+		// The BSDF sampling strategy: the material pdf, half mixed with the attractors if there are any
+		const pdf* sampling = srec.pdf_ptr;
+		if (!lights.attractors->objects.empty())
+			sampling = arena.create<mixture_pdf>(arena.create<hitable_pdf>(lights.attractors.get(), hrec.p), srec.pdf_ptr);
+
+		// Next-event estimation: one emitter picked uniformly, one point on it
+		if (!emitters.objects.empty())
+		{
+			double pick = smp.get_1d();
+			point2 u = smp.get_2d();
+			size_t n = emitters.objects.size();
+			const hitable& light = *emitters.objects[std::min(static_cast<size_t>(pick * n), n - 1)];
+			ray shadow(hrec.p, light.random(hrec.p, u.x, u.y), r.time());
+			double light_pdf = light.pdf_value(shadow.origin(), shadow.direction()) / n;
+			hit_record lrec;
+			if (light_pdf > 0 && light.hit(shadow, 0.001, infinity, lrec)
+				&& !world.occluded(shadow, 0.001, lrec.t * (1 - 1e-6)))
+			{
+				lrec.prim->compute_surface_interaction(shadow, lrec);
+				color le = lrec.mat_ptr->emitted(shadow, lrec, lrec.u, lrec.v, lrec.p);
+				double f = hrec.mat_ptr->scatter_pdf(r, hrec, shadow);
+				double weight = power_heuristic(light_pdf, sampling->value(shadow.direction()));
+				radiance += throughput * srec.attenuation * le * (f * weight / light_pdf);
+			}
+		}
+
+		ray scattered(hrec.p, sampling->generate(smp), r.time());
+		bsdf_pdf = sampling->value(scattered.direction());
+		if (bsdf_pdf <= 0)
+			break;
+		throughput = throughput * srec.attenuation * hrec.mat_ptr->scatter_pdf(r, hrec, scattered) / bsdf_pdf;
+		r = scattered;
+		specular_bounce = false;
+	}
+	return radiance;
+}
+
+#endif // !INTEGRATOR_H
@@ -0,0 +1,207 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+#include "hitable.h"
+#include "hitable_list.h"
+#include "bvh.h"
+#include "memory.h"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// One node of a depth-first flattened BVH. The first child of an interior node is the
+// node right after it, so only the second child's index has to be stored.
+struct alignas(32) linear_bvh_node
+{
+	float bounds_min[3];
+	float bounds_max[3];
+	union
+	{
+		uint32_t primitives_offset;		// leaf
+		uint32_t second_child_offset;	// interior
+	};
+	uint16_t n_primitives;	// 0 for interior nodes
+	uint8_t axis;			// split axis of interior nodes
+	uint8_t pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node must fill exactly half a cache line");
+
+// Rounds outward so the float box always contains the double one.
+inline float float_round_down(double x)
+{
+	float f = static_cast<float>(x);
+	return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float float_round_up(double x)
+{
+	float f = static_cast<float>(x);
+	return f < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+class linear_bvh : public hitable
+{
+public:
+	linear_bvh() = delete;
+	linear_bvh(const hitable_list& list, double time0, double time1, const bvh_build_options& options = bvh_build_options())
+	{
+		bvh_builder builder(list.objects, time0, time1, options);
+		build_seconds = builder.build_seconds;
+		primitives = std::move(builder.ordered);
+		if (!builder.root)
+			return;
+		// Every interior node on the way down to a leaf holds one entry of the traversal stack
+		assert(builder.max_depth <= bvh_max_depth);
+		nodes.reserve(2 * primitives.size());
+		flatten(*builder.root);
+	}
+
+	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+	{
+		if (nodes.empty())
+			return false;
+
+		const point3 o = r.origin();
+		const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+		const int dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+		bool hit_anything = false;
+		uint32_t to_visit[bvh_max_depth];
+		int to_visit_offset = 0;
+		uint32_t current = 0;
+		while (true)
+		{
+			const linear_bvh_node& node = nodes[current];
+			if (node_hit(node, o, inv_dir, dir_is_neg, t_min, t_max))
+			{
+				if (node.n_primitives > 0)
+				{
+					for (uint32_t i = 0; i < node.n_primitives; i++)
+						if (primitives[node.primitives_offset + i]->hit(r, t_min, t_max, rec))
+						{
+							hit_anything = true;
+							t_max = rec.t;
+						}
+					if (to_visit_offset == 0)
+						break;
+					current = to_visit[--to_visit_offset];
+				}
+				else if (dir_is_neg[node.axis])
+				{
+					// Visit the child on the ray's near side first
+					to_visit[to_visit_offset++] = current + 1;
+					current = node.second_child_offset;
+				}
+				else
+				{
+					to_visit[to_visit_offset++] = node.second_child_offset;
+					current = current + 1;
+				}
+			}
+			else
+			{
+				if (to_visit_offset == 0)
+					break;
+				current = to_visit[--to_visit_offset];
+			}
+		}
+		return hit_anything;
+	}
+
+	// Same traversal, but any hit ends it, so the visiting order does not matter
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		if (nodes.empty())
+			return false;
+
+		const point3 o = r.origin();
+		const vec3 inv_dir(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z());
+		const int dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+		uint32_t to_visit[bvh_max_depth];
+		int to_visit_offset = 0;
+		uint32_t current = 0;
+		while (true)
+		{
+			const linear_bvh_node& node = nodes[current];
+			if (node_hit(node, o, inv_dir, dir_is_neg, t_min, t_max))
+			{
+				if (node.n_primitives == 0)
+				{
+					to_visit[to_visit_offset++] = node.second_child_offset;
+					current = current + 1;
+					continue;
+				}
+				for (uint32_t i = 0; i < node.n_primitives; i++)
+					if (primitives[node.primitives_offset + i]->occluded(r, t_min, t_max))
+						return true;
+			}
+			if (to_visit_offset == 0)
+				return false;
+			current = to_visit[--to_visit_offset];
+		}
+	}
+
+	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	{
+		if (nodes.empty())
+			return false;
+		output_box = aabb(
+			point3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]),
+			point3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2]));
+		return true;
+	}
+
+private:
+	static bool node_hit(const linear_bvh_node& node, const point3& o, const vec3& inv_dir, const int dir_is_neg[3],
+		double t_min, double t_max)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			double t0 = ((dir_is_neg[a] ? node.bounds_max[a] : node.bounds_min[a]) - o[a]) * inv_dir[a];
+			double t1 = ((dir_is_neg[a] ? node.bounds_min[a] : node.bounds_max[a]) - o[a]) * inv_dir[a];
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+		}
+		return t_min <= t_max;
+	}
+
+	// Emits the subtree depth-first and returns its node index.
+	uint32_t flatten(const bvh_build_node& build_node)
+	{
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(linear_bvh_node());
+
+		linear_bvh_node& node = nodes[index];
+		for (int a = 0; a < 3; a++)
+		{
+			node.bounds_min[a] = float_round_down(build_node.box.min()[a]);
+			node.bounds_max[a] = float_round_up(build_node.box.max()[a]);
+		}
+		node.pad = 0;
+		node.axis = static_cast<uint8_t>(build_node.axis);
+		if (build_node.is_leaf())
+		{
+			assert(build_node.end - build_node.start <= static_cast<size_t>(bvh_max_leaf_size));
+			node.primitives_offset = static_cast<uint32_t>(build_node.start);
+			node.n_primitives = static_cast<uint16_t>(build_node.end - build_node.start);
+			return index;
+		}
+
+		node.n_primitives = 0;
+		flatten(*build_node.children[0]);
+		uint32_t second = flatten(*build_node.children[1]);
+		// nodes may have been reallocated by the recursive calls
+		nodes[index].second_child_offset = second;
+		return index;
+	}
+
+public:
+	std::vector<linear_bvh_node, aligned_allocator<linear_bvh_node, 32>> nodes;
+	std::vector<shared_ptr<hitable>> primitives;	// leaf order
+	double build_seconds = 0;
+};
+
+#endif // !LINEAR_BVH_H
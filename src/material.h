@@ -8,6 +8,7 @@
 #include "texture.h"
 #include "onb.h"
 #include "pdf.h"
+#include "memory.h"
 
 struct hit_record;
 
@@ -16,7 +17,7 @@ struct scatter_record
 	ray specular_ray;
 	bool is_specular;
 	vec3 attenuation;
-	shared_ptr<pdf> pdf_ptr;
+	const pdf* pdf_ptr = nullptr;	// lives in the arena passed to scatter()
 };
 
 class material
@@ -26,7 +27,7 @@ public:
 	{
 		return color(0, 0, 0);
 	}
-	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec) const
+	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec, memory_arena& arena) const
 	{
 		return false;
 	}
@@ -42,11 +43,11 @@ public:
 	lambertian(const color& a) : albedo(make_shared<solid_color>(a)) {}
 	lambertian(shared_ptr<texture> a) : albedo(a) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec) const override
+	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec, memory_arena& arena) const override
 	{
 		srec.is_specular = false;
 		srec.attenuation = albedo->value(hrec.u, hrec.v, hrec.p);
-		srec.pdf_ptr = make_shared<cosine_pdf>(hrec.normal);
+		srec.pdf_ptr = arena.create<cosine_pdf>(hrec.normal);
 		return true;
 	}
 
@@ -65,7 +66,7 @@ class metal : public material
 public:
 	metal(const color& a, double f) :albedo(a), fuzz(fabs(f) < 1 ? f : 1) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec) const override
+	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec, memory_arena& arena) const override
 	{
 		vec3 reflected = reflect(unit_vector(r_in.direction()), hrec.normal);
 		srec.specular_ray = ray(hrec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
@@ -85,7 +86,7 @@ class dielectric :public material
 public:
 	dielectric(double index_of_refraction) :ir(index_of_refraction) {};
 
-	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec) const override
+	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec, memory_arena& arena) const override
 	{
 		srec.attenuation = color(1.0, 1.0, 1.0);
 		double refraction_ratio = hrec.front_face ? (1.0 / ir) : ir;
@@ -167,7 +168,7 @@ public:
 	isotropic(color c) : albedo(make_shared<solid_color>(c)) {}
 	isotropic(shared_ptr<texture> a) : albedo(a) {}
 
-	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec) const override
+	virtual bool scatter(const ray& r_in, const hit_record& hrec, scatter_record& srec, memory_arena& arena) const override
 	{
 		srec.is_specular = true;
 		srec.specular_ray = ray(hrec.p, random_in_unit_sphere(), r_in.time());
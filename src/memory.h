@@ -0,0 +1,124 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+inline void* aligned_alloc_bytes(size_t size, size_t alignment)
+{
+#ifdef _MSC_VER
+	void* ptr = _aligned_malloc(size, alignment);
+#else
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, alignment, size) != 0)
+		ptr = nullptr;
+#endif
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+inline void aligned_free_bytes(void* ptr)
+{
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// std::allocator only honours alignof(T) up to the platform's new alignment before C++17,
+// so containers of over-aligned nodes go through this one instead.
+template <typename T, size_t Alignment>
+class aligned_allocator
+{
+public:
+	typedef T value_type;
+	template <typename U> struct rebind { typedef aligned_allocator<U, Alignment> other; };
+
+	aligned_allocator() = default;
+	template <typename U> aligned_allocator(const aligned_allocator<U, Alignment>&) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(aligned_alloc_bytes(n * sizeof(T), Alignment)); }
+	void deallocate(T* ptr, size_t) { aligned_free_bytes(ptr); }
+
+	template <typename U> bool operator==(const aligned_allocator<U, Alignment>&) const { return true; }
+	template <typename U> bool operator!=(const aligned_allocator<U, Alignment>&) const { return false; }
+};
+
+// Bump allocator for short-lived objects, such as the pdfs built at every bounce. Blocks are kept
+// across reset(), so once a thread has traced its longest path it stops calling the heap.
+// Nothing is ever destroyed, which is why create() only accepts trivially destructible types.
+class memory_arena
+{
+public:
+	explicit memory_arena(size_t block_size = 16 * 1024) : block_size(block_size) {}
+	~memory_arena()
+	{
+		for (const auto& b : blocks)
+			aligned_free_bytes(b.data);
+	}
+	memory_arena(const memory_arena&) = delete;
+	memory_arena& operator=(const memory_arena&) = delete;
+
+	void* alloc(size_t size, size_t alignment)
+	{
+		for (;;)
+		{
+			if (current < blocks.size())
+			{
+				size_t offset = (used + alignment - 1) & ~(alignment - 1);
+				if (offset + size <= blocks[current].size)
+				{
+					used = offset + size;
+					return blocks[current].data + offset;
+				}
+			}
+			if (current + 1 < blocks.size())
+				current++;
+			else
+			{
+				size_t size_bytes = size + alignment > block_size ? size + alignment : block_size;
+				blocks.push_back(block{ static_cast<char*>(aligned_alloc_bytes(size_bytes, block_alignment)), size_bytes });
+				current = blocks.size() - 1;
+			}
+			used = 0;
+		}
+	}
+
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+		static_assert(alignof(T) <= block_alignment, "over-aligned type");
+		return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	// Invalidates everything allocated so far and keeps the blocks for reuse.
+	void reset()
+	{
+		current = 0;
+		used = 0;
+	}
+
+private:
+	static const size_t block_alignment = 64;
+	struct block
+	{
+		char* data;
+		size_t size;
+	};
+	std::vector<block> blocks;
+	size_t current = 0;		// block being filled
+	size_t used = 0;		// bytes used in that block
+	size_t block_size;
+};
+
+#endif // !MEMORY_H
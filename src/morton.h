@@ -0,0 +1,122 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Spreads the low 10 bits of x so that two zero bits follow each of them.
+inline uint64_t left_shift3_10(uint64_t x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x30000ff;
+	x = (x | (x << 8)) & 0x300f00f;
+	x = (x | (x << 4)) & 0x30c30c3;
+	x = (x | (x << 2)) & 0x9249249;
+	return x;
+}
+
+// Spreads the low 21 bits of x so that two zero bits follow each of them.
+inline uint64_t left_shift3_21(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | (x << 32)) & 0x1f00000000ffffULL;
+	x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+	x = (x | (x << 8)) & 0x100f00f00f00f00fULL;
+	x = (x | (x << 4)) & 0x10c30c30c30c30c3ULL;
+	x = (x | (x << 2)) & 0x1249249249249249ULL;
+	return x;
+}
+
+// Interleaves the coordinates of a point in [0,1]^3 into a 30- or 63-bit Morton code.
+inline uint64_t morton_encode(double x, double y, double z, int bits)
+{
+	const int per_axis = bits >= 63 ? 21 : 10;
+	const double scale = static_cast<double>(1 << per_axis);
+	auto quantize = [&](double v) -> uint64_t
+	{
+		double q = v * scale;
+		return q <= 0 ? 0 : (q >= scale - 1 ? static_cast<uint64_t>(scale - 1) : static_cast<uint64_t>(q));
+	};
+	if (per_axis == 21)
+		return (left_shift3_21(quantize(z)) << 2) | (left_shift3_21(quantize(y)) << 1) | left_shift3_21(quantize(x));
+	return (left_shift3_10(quantize(z)) << 2) | (left_shift3_10(quantize(y)) << 1) | left_shift3_10(quantize(x));
+}
+
+inline int count_leading_zeros64(uint64_t x)
+{
+	if (x == 0)
+		return 64;
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return 63 - static_cast<int>(index);
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+struct morton_primitive
+{
+	uint64_t code;
+	uint32_t index;
+};
+
+// LSD radix sort on the low `bits` bits of the codes, 8 bits per pass. Every pass builds
+// per-thread digit histograms, turns them into per-thread scatter offsets and scatters in parallel.
+inline void radix_sort(std::vector<morton_primitive>& v, int bits)
+{
+	const int digit_bits = 8;
+	const int buckets = 1 << digit_bits;
+	std::vector<morton_primitive> tmp(v.size());
+#ifdef _OPENMP
+	const int max_threads = omp_get_max_threads();
+#else
+	const int max_threads = 1;
+#endif
+	std::vector<size_t> offsets(static_cast<size_t>(max_threads) * buckets);
+	const long long n = static_cast<long long>(v.size());
+
+	for (int shift = 0; shift < bits; shift += digit_bits)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0);
+#pragma omp parallel num_threads(max_threads)
+		{
+#ifdef _OPENMP
+			const int t = omp_get_thread_num();
+			const int nt = omp_get_num_threads();
+#else
+			const int t = 0;
+			const int nt = 1;
+#endif
+			const long long begin = n * t / nt, end = n * (t + 1) / nt;
+			size_t* count = &offsets[static_cast<size_t>(t) * buckets];
+			for (long long i = begin; i < end; i++)
+				count[(v[i].code >> shift) & (buckets - 1)]++;
+#pragma omp barrier
+#pragma omp single
+			{
+				// Digit-major, thread-minor exclusive prefix sum keeps the sort stable
+				size_t sum = 0;
+				for (int b = 0; b < buckets; b++)
+					for (int k = 0; k < nt; k++)
+					{
+						size_t c = offsets[static_cast<size_t>(k) * buckets + b];
+						offsets[static_cast<size_t>(k) * buckets + b] = sum;
+						sum += c;
+					}
+			}
+			for (long long i = begin; i < end; i++)
+				tmp[count[(v[i].code >> shift) & (buckets - 1)]++] = v[i];
+		}
+		v.swap(tmp);
+	}
+}
+
+#endif // !MORTON_H
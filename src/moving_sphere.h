@@ -5,6 +5,7 @@
 #include "vec3.h"
 #include "ray.h"
 #include "hitable.h"
+#include "sphere.h"
 
 class moving_sphere : public hitable
 {
@@ -24,28 +25,26 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
 	{
-		vec3 oc = r.origin() - center(r.time());
-		auto a = r.direction().length_squared();
-		auto half_b = dot(oc, r.direction());
-		auto c = oc.length_squared() - radius * radius;
-		auto discriminant = half_b * half_b - a * c;
-		if (discriminant < 0) return false;
-		auto sqrt_d = sqrt(discriminant);
-
-		// ҳ[t_min,t_max]еСֵ
-		auto root = (-half_b - sqrt_d) / a;
-		if (root < t_min || t_max < root) {
-			root = (-half_b + sqrt_d) / a;
-			if (root < t_min || t_max < root)
-				return false;
-		}
+		double root;
+		if (!sphere_intersect(r, center(r.time()), radius, t_min, t_max, root))
+			return false;
 		rec.t = root;
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
 		rec.p = r.at(rec.t);
 		vec3 outward_normal = (rec.p - center(r.time())) / radius;
 		rec.set_face_normal(r, outward_normal);
-		rec.mat_ptr = mat_ptr;
+		rec.mat_ptr = mat_ptr.get();
+	}
 
-		return true;
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		double root;
+		return sphere_intersect(r, center(r.time()), radius, t_min, t_max, root);
 	}
 
 	virtual bool bounding_box(double _time0, double _time1, aabb& output_box) const override
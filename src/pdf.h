@@ -5,12 +5,15 @@
 #include "vec3.h"
 #include "onb.h"
 #include "hitable.h"
+#include "sampler.h"
 
+// Pdfs are built per bounce in a memory_arena and refer to what they mix or sample by plain
+// pointer, so they must stay trivially destructible.
 class pdf
 {
 public:
 	virtual double value(const vec3& direction) const = 0;
-	virtual vec3 generate() const = 0;
+	virtual vec3 generate(sampler& s) const = 0;
 };
 
 class cosine_pdf : public pdf
@@ -24,9 +27,10 @@ public:
 		return cosine > 0 ? cosine / pi : 0;
 	}
 
-	virtual vec3 generate() const override
+	virtual vec3 generate(sampler& s) const override
 	{
-		return uvw.local(random_cosine_direction());
+		point2 u = s.get_2d();
+		return uvw.local(random_cosine_direction(u.x, u.y));
 	}
 
 public:
@@ -36,40 +40,43 @@ public:
 class hitable_pdf : public pdf
 {
 public:
-	hitable_pdf(shared_ptr<hitable> p, const vec3& origin) :ptr(p), o(origin) {}
+	hitable_pdf(const hitable* p, const vec3& origin) :ptr(p), o(origin) {}
 
 	virtual double value(const vec3& direction) const override
 	{
 		return ptr->pdf_value(o, direction);
 	}
 
-	virtual vec3 generate() const override
+	virtual vec3 generate(sampler& s) const override
 	{
-		return ptr->random(o);
+		point2 u = s.get_2d();
+		return ptr->random(o, u.x, u.y);
 	}
 
 public:
 	vec3 o;
-	shared_ptr<hitable> ptr;
+	const hitable* ptr;
 };
 
 class mixture_pdf : public pdf
 {
 public:
-	mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) : ptr0(p0), ptr1(p1) {}
+	mixture_pdf(const pdf* p0, const pdf* p1) : ptr0(p0), ptr1(p1) {}
 
 	virtual double value(const vec3& direction) const override
 	{
 		return 0.5 * ptr0->value(direction) + 0.5 * ptr1->value(direction);
 	}
 
-	virtual vec3 generate() const override
+	virtual vec3 generate(sampler& s) const override
 	{
-		return random_double() < 0.5 ? ptr0->generate() : ptr1->generate();
+		// Both branches draw one 2D sample, so later bounces stay on the same dimensions
+		return s.get_1d() < 0.5 ? ptr0->generate(s) : ptr1->generate(s);
 	}
 
 public:
-	shared_ptr<pdf> ptr0, ptr1;
+	const pdf* ptr0;
+	const pdf* ptr1;
 };
 
 #endif // !PDF_H
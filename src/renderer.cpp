@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "renderer.h"
+#include "scenes.h"
+#include "camera.h"
+#include "material.h"
+#include "wide_bvh.h"
+#include "image_writer.h"
+#include "framebuffer.h"
+
+// The OpenMP runtime calls the render uses, with a single thread when OpenMP is off
+static int max_render_threads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+static int render_thread()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+// Stores a pixel's current estimate in the framebuffer
+static void write_pixel(framebuffer& fb, int x, int y, const pixel_estimate& est)
+{
+	float* rgba = fb.pixel(x, y);
+	color mean = est.n > 0 ? est.sum / est.n : color(0, 0, 0);
+	rgba[0] = static_cast<float>(mean.x());
+	rgba[1] = static_cast<float>(mean.y());
+	rgba[2] = static_cast<float>(mean.z());
+	rgba[3] = 1.0f;
+	const size_t index = static_cast<size_t>(y) * fb.width() + x;
+	if (uint32_t* counts = fb.sample_counts())
+		counts[index] = static_cast<uint32_t>(est.n);
+	if (float* variance = fb.variance())
+		variance[index] = est.n > 1 ? static_cast<float>(est.m2_l / (est.n - 1)) : 0.0f;
+}
+
+// Hands a tile's current linear estimates to the image writer
+static void output_tile(image_writer& output, const tile_grid& grid, int t, const std::vector<pixel_estimate>& estimates)
+{
+	std::vector<color> pixels;
+	pixels.reserve(static_cast<size_t>(grid.size) * grid.size);
+	for (int j = grid.y0(t); j < grid.y1(t); j++)
+		for (int i = grid.x0(t); i < grid.x1(t); i++)
+		{
+			const pixel_estimate& est = estimates[static_cast<size_t>(j) * grid.width + i];
+			pixels.push_back(est.n > 0 ? est.sum / est.n : color(0, 0, 0));
+		}
+	output.write_tile(grid.x0(t), grid.y0(t), grid.x1(t), grid.y1(t), pixels.data());
+}
+
+// A built scene and the BVH over it, with what it was built from
+struct render_session::prepared_scene
+{
+	std::string name;
+	uint64_t seed = 0;
+	scene_description description;
+	shared_ptr<wide_bvh<wide_bvh_default_width>> accel;
+	hitable_list world;
+};
+
+render_session::render_session() {}
+render_session::~render_session() {}
+
+bool render_session::prepare(const render_settings& settings)
+{
+#ifdef _OPENMP
+	if (settings.threads > 0)
+		omp_set_num_threads(settings.threads);
+#endif
+	if (prepared && prepared->name == settings.scene && prepared->seed == settings.seed)
+		return true;
+	prepared.reset();
+	std::unique_ptr<prepared_scene> built(new prepared_scene);
+	// Scene construction draws from a stream of its own that no pixel uses
+	seed_thread_rng(settings.seed, scene_rng_stream, 0);
+	if (!build_scene(settings.scene, built->description))
+	{
+		std::cerr << "Error: unknown scene " << settings.scene << std::endl;
+		return false;
+	}
+	built->name = settings.scene;
+	built->seed = settings.seed;
+
+	// World
+	const scene_description& description = built->description;
+	built->accel = make_shared<wide_bvh<wide_bvh_default_width>>(description.objects, description.time0, description.time1);
+	built->world.add(built->accel);
+	std::cout << "BVH construction over " << description.objects.objects.size() << " objects took "
+		<< built->accel->build_seconds << " seconds" << std::endl;
+	prepared = std::move(built);
+	return true;
+}
+
+bool render_session::scene_camera(point3& lookfrom, point3& lookat, vec3& vup) const
+{
+	if (!prepared)
+		return false;
+	lookfrom = prepared->description.lookfrom;
+	lookat = prepared->description.lookat;
+	vup = prepared->description.vup;
+	return true;
+}
+
+bool render(const render_settings& settings, framebuffer* fb, image_writer* output, const cancel_token* cancel)
+{
+	render_session session;
+	return session.render(settings, fb, output, cancel);
+}
+
+bool render_session::render(const render_settings& settings, framebuffer* fb, image_writer* output, const cancel_token* cancel)
+{
+
+	printf("CGAssignment4 (built %s at %s) \n", __DATE__, __TIME__);
+	std::cout << "Ray-tracing based rendering launched..." << std::endl;
+
+	// Image
+	const int image_width = settings.image_width;
+	const int image_height = settings.image_height;
+	if (image_width < 2 || image_height < 2)
+	{
+		std::cerr << "Error: invalid image size " << image_width << "x" << image_height << " (both sides must be at least 2)" << std::endl;
+		return false;
+	}
+	if (fb && (fb->width() != image_width || fb->height() != image_height))
+	{
+		std::cerr << "Error: the " << fb->width() << "x" << fb->height() << " framebuffer does not match the "
+			<< image_width << "x" << image_height << " image" << std::endl;
+		return false;
+	}
+	const uint64_t seed = settings.seed;
+	const sampler_type sampling = settings.sampling;
+	const integrator_settings& integrator = settings.integrator;
+	adaptive_settings adaptive = settings.adaptive;
+	const progressive_settings& progressive = settings.progressive;
+	const tile_settings& tiling = settings.tiling;
+
+	if (!prepare(settings))
+		return false;
+	const scene_description& scene = prepared->description;
+	const hitable_list& world = prepared->world;
+	const int samples_per_pixel = settings.samples_per_pixel > 0 ? settings.samples_per_pixel : scene.samples_per_pixel;
+	const scene_lights& lights = scene.lights;
+	const color background = scene.background;
+	const double time0 = scene.time0, time1 = scene.time1;
+
+	// Camera
+	const double aspect_ratio = static_cast<double>(image_width) / image_height;
+	const point3 lookfrom = orbit_lookfrom(scene.lookfrom, scene.lookat, scene.vup, settings.orbit);
+	camera cam(lookfrom, scene.lookat, scene.vup, scene.vfov, aspect_ratio, scene.aperture, scene.dist_to_focus, time0, time1);
+
+	// Without adaptive sampling a one-shot render gives every pixel its full budget in a single pass.
+	// A time budget lifts the sample limit; samples_per_pixel still sizes the sampler's strata.
+	adaptive.max_spp = progressive.time_budget > 0 ? std::numeric_limits<int>::max() : samples_per_pixel;
+	if (!adaptive.enabled && !progressive.enabled)
+		adaptive.min_spp = adaptive.pass_spp = samples_per_pixel;
+	std::vector<pixel_estimate> estimates(static_cast<size_t>(image_width) * image_height);
+
+	// The render stops when the caller cancels or its time budget runs out
+	auto startFrame = std::chrono::steady_clock::now();
+	cancel_token stop(cancel);
+	if (progressive.time_budget > 0)
+		stop.set_deadline(startFrame + std::chrono::duration_cast<cancel_token::clock::duration>(std::chrono::duration<double>(progressive.time_budget)));
+
+	// Render
+	// The main ray-tracing based rendering loop, in passes. A one-shot render first gives every
+	// pixel min_spp samples and then adds adaptive.pass_spp to the tiles whose error is still too
+	// large; a progressive one adds progressive.pass_size() per pass from the start, and tiles may
+	// stop once they have min_spp. Each pass hands the unfinished tiles out through a
+	// work-stealing scheduler, and every tile is published to the framebuffer as soon as it is done.
+	// Tiles go to the image writer once they are finished, or when the render stops early.
+	// A tile interrupted by the time budget keeps the pixels it finished; a cancelled render drops
+	// the tile it is in and publishes nothing more.
+	const tile_grid grid(image_width, image_height, tiling.size);
+	// One camera sample through pixel (i, j); samples are numbered per pixel
+	auto trace = [&](int i, int j, int s, sampler& smp, memory_arena& arena) -> color
+	{
+		// Materials and media still draw from the thread generator
+		seed_thread_rng(seed, static_cast<uint64_t>(j) * image_width + i, s);
+		smp.start_pixel_sample(i, j, s);
+		point2 jitter = smp.get_2d();
+		auto u = (i + jitter.x) / (image_width - 1);
+		auto v = (j + jitter.y) / (image_height - 1);
+		ray r = cam.get_ray(u, v, smp);
+		return de_nan(ray_color(r, background, world, lights, integrator, smp, arena));
+	};
+	std::vector<char> tile_done(grid.count(), 0);
+	std::vector<double> tile_seconds(grid.count(), 0.0);
+	std::vector<double> thread_seconds(max_render_threads(), 0.0);
+	int steals = 0;
+	std::vector<int> pending = grid.ordered(tiling.order);
+	int pass_begin = 0;
+	int passes = 0;
+
+	// What the samples depend on, as a checkpoint records it
+	auto describe = [&](render_checkpoint& cp)
+	{
+		cp.scene = settings.scene;
+		cp.width = image_width;
+		cp.height = image_height;
+		cp.tile_size = tiling.size;
+		cp.samples_per_pixel = samples_per_pixel;
+		cp.seed = seed;
+		cp.sampling = static_cast<int>(sampling);
+		cp.max_depth = integrator.max_depth;
+		cp.rr_min_bounces = integrator.rr_min_bounces;
+		cp.orbit = settings.orbit;
+	};
+
+	// A resumed render takes over the estimates, finished tiles and pass count, and passes pick up
+	// at each pixel's own sample count, so it ends with the sums an uninterrupted render has
+	const checkpoint_settings& checkpointing = settings.checkpoint;
+	if (checkpointing.resume)
+	{
+		render_checkpoint expected, cp;
+		describe(expected);
+		if (!load_checkpoint(checkpointing.path, cp))
+		{
+			std::cerr << "Error: failed to read the checkpoint " << checkpointing.path << std::endl;
+			return false;
+		}
+		if (!expected.same_samples(cp, std::cerr))
+			return false;
+		estimates = std::move(cp.estimates);
+		tile_done = std::move(cp.tile_done);
+		pass_begin = cp.pass_begin;
+		passes = cp.passes;
+		pending.erase(std::remove_if(pending.begin(), pending.end(), [&](int t) { return tile_done[t] != 0; }), pending.end());
+		for (int t = 0; t < grid.count(); t++)
+		{
+			if (fb)
+			{
+				for (int j = grid.y0(t); j < grid.y1(t); j++)
+					for (int i = grid.x0(t); i < grid.x1(t); i++)
+						write_pixel(*fb, i, j, estimates[static_cast<size_t>(j) * image_width + i]);
+				fb->publish(grid.x0(t), grid.y0(t), grid.x1(t), grid.y1(t));
+			}
+			if (tile_done[t] && output)
+				output_tile(*output, grid, t, estimates);
+		}
+		std::cout << "Resumed from " << checkpointing.path << " after " << passes << " passes, "
+			<< grid.count() - pending.size() << " of " << grid.count() << " tiles done" << std::endl;
+	}
+
+	// Checkpoints are taken between passes, when the estimates are still, and written on the side
+	std::unique_ptr<checkpoint_writer> checkpoints;
+	if (!checkpointing.path.empty())
+		checkpoints.reset(new checkpoint_writer(checkpointing.path));
+	auto last_checkpoint = std::chrono::steady_clock::now();
+	auto take_checkpoint = [&]()
+	{
+		std::unique_ptr<render_checkpoint> cp(new render_checkpoint);
+		describe(*cp);
+		cp->pass_begin = pass_begin;
+		cp->passes = passes;
+		cp->tile_done = tile_done;
+		cp->estimates = estimates;
+		checkpoints->submit(std::move(cp));
+		last_checkpoint = std::chrono::steady_clock::now();
+	};
+
+	// Previews trace one sample per 8x8 and then per 4x4 block of each tile and fill the block
+	// with it. The samples are not added to the estimates, which the full passes start afresh.
+	if (fb && progressive.preview)
+		for (int block : { 8, 4 })
+		{
+			tile_scheduler scheduler(pending, max_render_threads(), &stop);
+#pragma omp parallel
+			{
+				std::unique_ptr<sampler> smp = make_sampler(sampling, samples_per_pixel, seed);
+				memory_arena arena;
+				int t;
+				while (scheduler.next(render_thread(), t))
+				{
+					for (int j = grid.y0(t); j < grid.y1(t); j += block)
+						for (int i = grid.x0(t); i < grid.x1(t); i += block)
+						{
+							const int bx1 = std::min(i + block, grid.x1(t)), by1 = std::min(j + block, grid.y1(t));
+							color c = trace((i + bx1) / 2, (j + by1) / 2, 0, *smp, arena);
+							for (int y = j; y < by1; y++)
+								for (int x = i; x < bx1; x++)
+								{
+									float* rgba = fb->pixel(x, y);
+									rgba[0] = static_cast<float>(c.x());
+									rgba[1] = static_cast<float>(c.y());
+									rgba[2] = static_cast<float>(c.z());
+									rgba[3] = 1.0f;
+								}
+						}
+					fb->publish(grid.x0(t), grid.y0(t), grid.x1(t), grid.y1(t));
+				}
+			}
+		}
+
+	while (!pending.empty() && pass_begin < adaptive.max_spp
+		&& (!progressive.enabled || progressive.max_passes <= 0 || passes < progressive.max_passes)
+		&& !stop.stop_requested())
+	{
+		int pass_end = progressive.enabled ? pass_begin + progressive.pass_size(passes)
+			: (pass_begin == 0 ? adaptive.min_spp : pass_begin + adaptive.pass_spp);
+		pass_end = std::min(adaptive.max_spp, pass_end);
+		tile_scheduler scheduler(pending, max_render_threads(), &stop);
+#pragma omp parallel
+		{
+			// Samplers keep per-sample state, so every thread gets its own, and its own arena
+			std::unique_ptr<sampler> smp = make_sampler(sampling, samples_per_pixel, seed);
+			memory_arena arena;
+			const int thread = render_thread();
+			int t;
+			while (scheduler.next(thread, t))
+			{
+				auto tile_start = std::chrono::steady_clock::now();
+				double tile_error = 0;
+				bool complete = true;
+				for (int j = grid.y0(t); j < grid.y1(t) && complete; j++)
+				{
+					for (int i = grid.x0(t); i < grid.x1(t); i++)
+					{
+						if (stop.stop_requested())
+						{
+							complete = false;
+							break;
+						}
+						pixel_estimate& est = estimates[static_cast<size_t>(j) * image_width + i];
+						for (int s = est.n; s < pass_end; s++)
+							est.add(trace(i, j, s, *smp, arena));
+						tile_error = fmax(tile_error, est.relative_error());
+						if (fb)
+							write_pixel(*fb, i, j, est);
+					}
+				}
+				if (stop.cancelled())
+					break;
+				if (fb)
+					fb->publish(grid.x0(t), grid.y0(t), grid.x1(t), grid.y1(t));
+				tile_done[t] = complete && (pass_end >= adaptive.max_spp
+					|| (adaptive.enabled && pass_end >= adaptive.min_spp && tile_error < adaptive.error_threshold));
+				if (tile_done[t] && output)
+					output_tile(*output, grid, t, estimates);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tile_start).count();
+				tile_seconds[t] += seconds;
+				thread_seconds[thread] += seconds;
+			}
+		}
+		steals += scheduler.steals;
+		// Keep the scheduling order for the next pass
+		pending.erase(std::remove_if(pending.begin(), pending.end(), [&](int t) { return tile_done[t] != 0; }), pending.end());
+		// A pass cut short by the budget is taken up again by a resumed render
+		if (!stop.stop_requested())
+		{
+			pass_begin = pass_end;
+			passes++;
+		}
+		if (checkpoints && std::chrono::duration<double>(std::chrono::steady_clock::now() - last_checkpoint).count()
+			>= checkpointing.interval && !checkpoints->busy())
+			take_checkpoint();
+	}
+	if (stop.cancelled())
+	{
+		std::cout << "Ray-tracing based rendering cancelled after " << passes << " passes" << std::endl;
+		return true;
+	}
+	// A render stopped by its pass limit or time budget leaves tiles pending, and its progress
+	// is saved so that it can be resumed
+	if (output)
+		for (int t : pending)
+			output_tile(*output, grid, t, estimates);
+	if (checkpoints && !pending.empty())
+	{
+		std::cout << "Saving a checkpoint to " << checkpointing.path << std::endl;
+		take_checkpoint();
+	}
+
+	double timeConsuming = std::chrono::duration<double>(std::chrono::steady_clock::now() - startFrame).count();
+	std::cout << "Ray-tracing based rendering over..." << std::endl;
+	std::cout << "The rendering task took " << timeConsuming << " seconds in " << passes << " passes" << std::endl;
+	print_spp_histogram(estimates, std::cout);
+	if (tiling.report_timing)
+		print_tile_timing(grid, tile_seconds, thread_seconds, steals, std::cout);
+	return true;
+}
@@ -0,0 +1,70 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include "sampler.h"
+#include "adaptive.h"
+#include "integrator.h"
+#include "scheduler.h"
+#include "camera.h"
+#include "cancel.h"
+#include "checkpoint.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct render_settings
+{
+	int image_width = 800;
+	int image_height = 450;
+	std::string scene = "cornell_box_spot";	// a name from scene_registry()
+	int samples_per_pixel = 0;			// 0 keeps the scene's own count
+	int threads = 0;					// 0 leaves the count to OpenMP
+	uint64_t seed = 0;					// same seed, same image, whatever the thread count
+	sampler_type sampling = sampler_type::sobol;
+	integrator_settings integrator;		// max_depth and the Russian roulette start
+	adaptive_settings adaptive;			// max_spp follows the scene's samples_per_pixel
+	progressive_settings progressive;
+	tile_settings tiling;
+	camera_orbit orbit;					// the viewer's edits to the scene's camera
+	checkpoint_settings checkpoint;
+};
+
+class framebuffer;
+class image_writer;
+
+// Renders settings.scene. If fb is given it must be image_width x image_height, and receives
+// every tile's current estimate as the tile finishes each pass; if output is given and open, it
+// receives every tile's linear radiance once the tile is finished. Returns false if the image
+// size is invalid, the framebuffer does not match it or the scene is unknown.
+// Cancelling the token abandons the render within a pixel; nothing more reaches fb or output,
+// and the call returns true.
+bool render(const render_settings& settings, framebuffer* fb, image_writer* output = nullptr,
+	const cancel_token* cancel = nullptr);
+
+// Keeps a built scene, its textures and its BVH between renders, so a render restarted after a
+// cancellation, a camera edit or a change of resolution starts tracing at once. The scene is
+// only built again when the settings name another scene or seed.
+class render_session
+{
+public:
+	render_session();
+	~render_session();
+
+	// Renders as the free function does
+	bool render(const render_settings& settings, framebuffer* fb, image_writer* output = nullptr,
+		const cancel_token* cancel = nullptr);
+
+	// Builds the scene settings name unless it is already built; render() does this itself
+	bool prepare(const render_settings& settings);
+
+	// The prepared scene's own camera, before any orbit; false if nothing is prepared
+	bool scene_camera(point3& lookfrom, point3& lookat, vec3& vup) const;
+
+private:
+	struct prepared_scene;
+	std::unique_ptr<prepared_scene> prepared;
+};
+
+#endif // !RENDERER_H
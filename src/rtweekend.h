@@ -2,9 +2,9 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
-#include <random>
 
 // Usings
 using std::shared_ptr;
@@ -18,11 +18,70 @@ const double pi = 3.1415926535897932385;
 // Utility Functions
 inline double degrees_to_radians(double degrees) { return degrees * pi / 180.0; }
 
+// Finalizer of the SplitMix64 generator, used to hash seeds and counters into well mixed 64-bit values.
+inline uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// PCG32 (XSH-RR): 64-bit LCG state with a permuted 32-bit output. Every odd increment selects
+// an independent stream, so one generator per (pixel, sample) needs only two words of state.
+class pcg32
+{
+public:
+	pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+	pcg32(uint64_t init_state, uint64_t init_seq) { seed(init_state, init_seq); }
+
+	void seed(uint64_t init_state, uint64_t init_seq)
+	{
+		state = 0;
+		inc = (init_seq << 1) | 1;
+		next_uint();
+		state += init_state;
+		next_uint();
+	}
+
+	uint32_t next_uint()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+		uint32_t rot = static_cast<uint32_t>(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// Uniform in [0,1) with 32 bits of resolution
+	double next_double() { return next_uint() * (1.0 / 4294967296.0); }
+
+public:
+	uint64_t state;
+	uint64_t inc;
+};
+
+// Every thread draws from its own generator, so samples never contend on shared state.
+inline pcg32& thread_rng()
+{
+	thread_local pcg32 rng;
+	return rng;
+}
+
+// Restarts the calling thread's generator on the stream of one (pixel, sample) pair. Seeding by
+// what is being computed instead of by thread makes renders reproducible for any thread count.
+inline void seed_thread_rng(uint64_t seed, uint64_t pixel, uint64_t sample)
+{
+	thread_rng().seed(splitmix64(seed ^ splitmix64(pixel)), sample);
+}
+
+// The pixel index scene construction seeds the thread generator with. No image reaches it, so
+// a seed builds the same scene at every resolution.
+const uint64_t scene_rng_stream = UINT64_MAX;
+
 inline double random_double()
 {
-	static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	static std::mt19937 generator;
-	return distribution(generator);
+	return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max)
@@ -32,7 +91,7 @@ inline double random_double(double min, double max)
 
 inline double clamp(double x, double min, double max)
 {
-	if (isnan(x)) return min;
+	if (std::isnan(x)) return min;
 	if (x < min)return min;
 	if (x > max) return max;
 	return x;
@@ -0,0 +1,392 @@
+// The one translation unit that compiles stb_image
+#define STB_IMAGE_IMPLEMENTATION
+#include "texture.h"
+
+#include "scenes.h"
+#include "sphere.h"
+#include "moving_sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include "constant_medium.h"
+#include "material.h"
+#include "bvh.h"
+#include "wide_bvh.h"
+#include <cstdlib>
+
+void random_scene(hitable_list& objects, scene_lights& lights)
+{
+	auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+	for (int a = -11; a < 11; a++) {
+		for (int b = -11; b < 11; b++)
+		{
+			auto choose_mat = random_double();
+			point3 center(a + 0.9 * random_double(), 0.2, b +
+				0.9 * random_double());
+			if ((center - vec3(4, 0.2, 0)).length() > 0.9)
+			{
+				shared_ptr<material> sphere_material;
+				if (choose_mat < 0.8)
+				{
+					// diffuse
+					auto albedo = color::random() * color::random();
+					sphere_material = make_shared<lambertian>(albedo);
+					auto center2 = center + vec3(0, random_double(0, .5), 0);
+					objects.add(make_shared<moving_sphere>(center, center2, 0.0, 1.0, 0.2, sphere_material));
+				}
+				else if (choose_mat < 0.95)
+				{
+					// metal
+					auto albedo = color::random(0.5, 1);
+					auto fuzz = random_double(0, 0.5);
+					sphere_material = make_shared<metal>(albedo, fuzz);
+					objects.add(make_shared<sphere>(center, 0.2, sphere_material));
+				}
+				else
+				{
+					// glass
+					sphere_material = make_shared<dielectric>(1.5);
+					objects.add(make_shared<sphere>(center, 0.2, sphere_material));
+				}
+			}
+		}
+	}
+	auto material1 = make_shared<dielectric>(1.5);
+	auto glass_sphere = make_shared<sphere>(point3(0, 1, 0), 1.0, material1);
+	objects.add(glass_sphere);
+	lights.attractors->add(glass_sphere);
+	auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+	objects.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+	auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+	objects.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+}
+
+void two_spheres(hitable_list& objects, scene_lights& lights)
+{
+	auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+	objects.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
+	objects.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
+}
+
+void two_perlin_spheres(hitable_list& objects, scene_lights& lights)
+{
+	auto pertext = make_shared<noise_texture>(4);
+	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
+	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+}
+
+void earth(hitable_list& objects, scene_lights& lights)
+{
+	auto earth_texture = make_shared<image_texture>("earthmap.jpg");
+	auto earth_surface = make_shared<lambertian>(earth_texture);
+	auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+	objects.add(globe);
+}
+
+void simple_light(hitable_list& objects, scene_lights& lights)
+{
+	auto pertext = make_shared<noise_texture>(4);
+	objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
+	objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+	auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
+	objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
+	auto light_sphere = make_shared<sphere>(point3(0, 7, 0), 2, difflight);
+	objects.add(light_sphere);
+	lights.emitters->add(light_sphere);
+}
+
+void cornell_box(hitable_list& objects, scene_lights& lights)
+{
+	auto red = make_shared<lambertian>(color(.65, .05, .05));
+	auto white = make_shared<lambertian>(color(.73, .73, .73));
+	auto green = make_shared<lambertian>(color(.12, .45, .15));
+	auto light = make_shared<diffuse_light>(color(15, 15, 15));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	auto light_src = make_shared<xz_rect>(213, 343, 227, 332, 554, light);
+	objects.add(light_src);
+	lights.emitters->add(light_src);
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+	shared_ptr<hitable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
+	box1 = make_shared<rotate_y>(box1, 15);
+	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+	objects.add(box1);
+	shared_ptr<hitable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+	box2 = make_shared<rotate_y>(box2, -18);
+	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+	objects.add(box2);
+	auto glass_sphere = make_shared<sphere>(point3(190, 255, 190), 90, make_shared<dielectric>(1.5));
+	objects.add(glass_sphere);
+	lights.attractors->add(glass_sphere);
+}
+
+void cornell_smoke(hitable_list& objects, scene_lights& lights)
+{
+	auto red = make_shared<lambertian>(color(.65, .05, .05));
+	auto white = make_shared<lambertian>(color(.73, .73, .73));
+	auto green = make_shared<lambertian>(color(.12, .45, .15));
+	auto light = make_shared<diffuse_light>(color(7, 7, 7));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	auto light_src = make_shared<xz_rect>(113, 443, 127, 432, 554, light);
+	objects.add(light_src);
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+	shared_ptr<hitable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
+	box1 = make_shared<rotate_y>(box1, 15);
+	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+	shared_ptr<hitable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+	box2 = make_shared<rotate_y>(box2, -18);
+	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+	objects.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
+	objects.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
+}
+
+void final_scene(hitable_list& objects, scene_lights& lights)
+{
+	hitable_list boxes1;
+	auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+	const int boxes_per_side = 20;
+	for (int i = 0; i < boxes_per_side; i++)
+		for (int j = 0; j < boxes_per_side; j++)
+		{
+			auto w = 100.0;
+			auto x0 = -1000.0 + i * w;
+			auto z0 = -1000.0 + j * w;
+			auto y0 = 0.0;
+			auto x1 = x0 + w;
+			auto y1 = random_double(1, 101);
+			auto z1 = z0 + w;
+			boxes1.add(make_shared<box>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+		}
+	objects.add(make_shared<wide_bvh<wide_bvh_default_width>>(boxes1, 0, 1));
+	auto light = make_shared<diffuse_light>(color(7, 7, 7));
+	auto light_src = make_shared<xz_rect>(123, 423, 147, 412, 554, light);
+	objects.add(light_src);
+	lights.emitters->add(light_src);
+	auto center1 = point3(400, 400, 200);
+	auto center2 = center1 + vec3(30, 0, 0);
+	auto moving_sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
+	objects.add(make_shared<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+	auto glass_sphere = make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5));
+	objects.add(glass_sphere);
+	lights.attractors->add(glass_sphere);
+	objects.add(make_shared<sphere>(point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)));
+	auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
+	objects.add(boundary);
+	lights.attractors->add(boundary);
+	objects.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+	boundary = make_shared<sphere>(point3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
+	objects.add(make_shared<constant_medium>(boundary, .0001, color(1, 1, 1)));
+	auto emat = make_shared<lambertian>(make_shared<image_texture>("earthmap.jpg"));
+	objects.add(make_shared<sphere>(point3(400, 200, 400), 100, emat));
+	auto pertext = make_shared<noise_texture>(0.1);
+	objects.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(pertext)));
+	hitable_list boxes2;
+	auto white = make_shared<lambertian>(color(.73, .73, .73));
+	int ns = 1000;
+	for (int j = 0; j < ns; j++)
+		boxes2.add(make_shared<sphere>(point3::random(0, 165), 10, white));
+	objects.add(make_shared<translate>(make_shared<rotate_y>(make_shared<wide_bvh<wide_bvh_default_width>>(boxes2, 0.0, 1.0), 15), vec3(-100, 270, 395)));
+}
+
+void cornell_box_spot(hitable_list& objects, scene_lights& lights)
+{
+	auto red = make_shared<lambertian>(color(.65, .05, .05));
+	auto white = make_shared<lambertian>(color(.73, .73, .73));
+	auto green = make_shared<lambertian>(color(.12, .45, .15));
+	auto spot = make_shared<spot_light>(color(20, 20, 20), vec3(0.0, -1.0, 0.0), 22.5);
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	auto light_src = make_shared<xz_rect>(213, 343, 227, 332, 554.99, spot);
+	objects.add(light_src);
+	lights.emitters->add(light_src);
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+	shared_ptr<hitable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
+	box1 = make_shared<rotate_y>(box1, 15);
+	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+	objects.add(box1);
+	shared_ptr<hitable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+	box2 = make_shared<rotate_y>(box2, -18);
+	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+	objects.add(box2);
+	auto glass_sphere = make_shared<sphere>(point3(190, 255, 190), 90, make_shared<dielectric>(1.5));
+	objects.add(glass_sphere);
+	lights.attractors->add(glass_sphere);
+}
+
+void cornell_box_light(hitable_list& objects, scene_lights& lights)
+{
+	auto red = make_shared<lambertian>(color(.65, .05, .05));
+	auto white = make_shared<lambertian>(color(.73, .73, .73));
+	auto green = make_shared<lambertian>(color(.12, .45, .15));
+	auto light = make_shared<diffuse_light>(color(3, 1.4, 0.4));
+	auto aluminum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+	objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+	objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+	objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+	shared_ptr<hitable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), aluminum);
+	box1 = make_shared<rotate_y>(box1, 15);
+	box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+	objects.add(box1);
+	shared_ptr<hitable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+	box2 = make_shared<rotate_y>(box2, -18);
+	box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+	objects.add(box2);
+	auto light_sphere = make_shared<sphere>(point3(190, 195, 190), 30, light);
+	objects.add(light_sphere);
+	lights.emitters->add(light_sphere);
+}
+
+void universe(hitable_list& objects, scene_lights& lights)
+{
+	auto stars = make_shared<sphere>(point3(0, 0, 0), 1000, make_shared<diffuse_light>(make_shared<image_texture>("stars.jpg")));
+	objects.add(stars);
+	auto sun = make_shared<sphere>(point3(-50, 0, 0), 100, make_shared<diffuse_light>(make_shared<image_texture>("sun.jpg")));
+	objects.add(sun);
+	lights.emitters->add(sun);
+	auto mercury = make_shared<sphere>(75 * unit_vector(point3(1, 0, 1)), 2, make_shared<lambertian>(make_shared<image_texture>("mercury.jpg")));
+	objects.add(mercury);
+	auto venus = make_shared<sphere>(91 * unit_vector(point3(1, 0, -0.6)), 6, make_shared<lambertian>(make_shared<image_texture>("venus.jpg")));
+	objects.add(venus);
+	auto earth = make_shared<sphere>((point3(0, 0, 0)), 7, make_shared<lambertian>(make_shared<image_texture>("earth.jpg")));
+	objects.add(make_shared<translate>(make_shared<rotate_y>(earth, 180), 115 * unit_vector(point3(1, 0, 1))));
+	auto mars = make_shared<sphere>(133 * unit_vector(point3(1, 0, -0.1)), 3, make_shared<lambertian>(make_shared<image_texture>("mars.jpg")));
+	objects.add(mars);
+	auto jupiter = make_shared<sphere>(279 * unit_vector(point3(1, 0, -2)), 30, make_shared<lambertian>(make_shared<image_texture>("jupiter.jpg")));
+	objects.add(jupiter);
+	for (int i = 0; i < 5000; i++)
+		objects.add(make_shared<sphere>(vec3(0,random_double(-2.0,2.0), 0) + (150 + random_double() * 50) * unit_vector(point3(1, 0, random_double(-5.5, 1))), random_double(0.1, 0.5), make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+}
+
+const std::vector<scene_entry>& scene_registry()
+{
+	// In the order of the old scene numbers, which find_scene() still accepts
+	static const std::vector<scene_entry> scenes = {
+		{ "random_scene", [](scene_description& s)
+		{
+			random_scene(s.objects, s.lights);
+			s.background = color(0.7, 0.8, 1.0);
+			s.lookfrom = point3(13, 2, 3);
+			s.lookat = point3(0, 0, 0);
+			s.vfov = 20.0;
+			s.aperture = 0.1;
+		} },
+		{ "two_spheres", [](scene_description& s)
+		{
+			two_spheres(s.objects, s.lights);
+			s.background = color(0.7, 0.8, 1.0);
+			s.lookfrom = point3(13, 2, 3);
+			s.lookat = point3(0, 0, 0);
+			s.vfov = 20.0;
+		} },
+		{ "two_perlin_spheres", [](scene_description& s)
+		{
+			two_perlin_spheres(s.objects, s.lights);
+			s.background = color(0.7, 0.8, 1.0);
+			s.lookfrom = point3(13, 2, 3);
+			s.lookat = point3(0, 0, 0);
+			s.vfov = 20.0;
+		} },
+		{ "earth", [](scene_description& s)
+		{
+			earth(s.objects, s.lights);
+			s.background = color(0.7, 0.8, 1.0);
+			s.lookfrom = point3(13, 2, 3);
+			s.lookat = point3(0, 0, 0);
+			s.vfov = 20.0;
+		} },
+		{ "simple_light", [](scene_description& s)
+		{
+			simple_light(s.objects, s.lights);
+			s.background = color(0, 0, 0);
+			s.samples_per_pixel = 400;
+			s.lookfrom = point3(26, 3, 6);
+			s.lookat = point3(0, 2, 0);
+			s.vfov = 20.0;
+		} },
+		{ "cornell_box", [](scene_description& s)
+		{
+			cornell_box(s.objects, s.lights);
+			s.samples_per_pixel = 500;
+			s.background = color(0, 0, 0);
+			s.lookfrom = point3(278, 278, -800);
+			s.lookat = point3(278, 278, 0);
+			s.vfov = 40.0;
+		} },
+		{ "cornell_smoke", [](scene_description& s)
+		{
+			cornell_smoke(s.objects, s.lights);
+			s.samples_per_pixel = 200;
+			s.lookfrom = point3(278, 278, -800);
+			s.lookat = point3(278, 278, 0);
+			s.vfov = 40.0;
+		} },
+		{ "final_scene", [](scene_description& s)
+		{
+			final_scene(s.objects, s.lights);
+			s.samples_per_pixel = 10000;
+			s.background = color(0, 0, 0);
+			s.lookfrom = point3(478, 278, -600);
+			s.lookat = point3(278, 278, 0);
+			s.vfov = 40.0;
+		} },
+		{ "cornell_box_spot", [](scene_description& s)
+		{
+			cornell_box_spot(s.objects, s.lights);
+			s.samples_per_pixel = 1000;
+			s.background = color(0, 0, 0);
+			s.lookfrom = point3(278, 278, -800);
+			s.lookat = point3(278, 278, 0);
+			s.vfov = 40.0;
+		} },
+		{ "cornell_box_light", [](scene_description& s)
+		{
+			cornell_box_light(s.objects, s.lights);
+			s.samples_per_pixel = 1000;
+			s.background = color(0, 0, 0);
+			s.lookfrom = point3(278, 278, -800);
+			s.lookat = point3(278, 278, 0);
+			s.vfov = 40.0;
+		} },
+		{ "universe", [](scene_description& s)
+		{
+			universe(s.objects, s.lights);
+			s.samples_per_pixel = 1000;
+			s.background = color(1.0, 1.0, 1.0);
+			s.lookfrom = point3(50, 50, 200);
+			s.lookat = point3(100, 0, 0);
+			s.vfov = 30.0;
+		} }
+	};
+	return scenes;
+}
+
+int find_scene(const std::string& name)
+{
+	const auto& scenes = scene_registry();
+	for (size_t k = 0; k < scenes.size(); k++)
+		if (name == scenes[k].name)
+			return static_cast<int>(k);
+	char* end = nullptr;
+	long number = strtol(name.c_str(), &end, 10);
+	if (!name.empty() && *end == '\0' && number >= 1 && number <= static_cast<long>(scenes.size()))
+		return static_cast<int>(number - 1);
+	return -1;
+}
+
+bool build_scene(const std::string& name, scene_description& scene)
+{
+	int index = find_scene(name);
+	if (index < 0)
+		return false;
+	scene_registry()[index].setup(scene);
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+#include "vec3.h"
+#include "hitable_list.h"
+#include "integrator.h"
+#include <string>
+#include <vector>
+
+// A scene's geometry and lights together with the camera and sample count it is meant to be
+// rendered with.
+struct scene_description
+{
+	hitable_list objects;
+	scene_lights lights;
+	color background = color(0, 0, 0);
+	int samples_per_pixel = 100;
+	point3 lookfrom, lookat;
+	vec3 vup = vec3(0, 1, 0);
+	double vfov = 40.0;
+	double dist_to_focus = 10.0;
+	double aperture = 0.0;
+	double time0 = 0.0, time1 = 1.0;
+};
+
+void random_scene(hitable_list& objects, scene_lights& lights);
+void two_spheres(hitable_list& objects, scene_lights& lights);
+void two_perlin_spheres(hitable_list& objects, scene_lights& lights);
+void earth(hitable_list& objects, scene_lights& lights);
+void simple_light(hitable_list& objects, scene_lights& lights);
+void cornell_box(hitable_list& objects, scene_lights& lights);
+void cornell_smoke(hitable_list& objects, scene_lights& lights);
+void final_scene(hitable_list& objects, scene_lights& lights);
+void cornell_box_spot(hitable_list& objects, scene_lights& lights);
+void cornell_box_light(hitable_list& objects, scene_lights& lights);
+void universe(hitable_list& objects, scene_lights& lights);
+
+struct scene_entry
+{
+	const char* name;
+	void (*setup)(scene_description& scene);
+};
+
+// Every scene by name, with its camera and sample count
+const std::vector<scene_entry>& scene_registry();
+
+// Index in scene_registry() of a scene given by name or by its 1-based number; -1 if unknown.
+int find_scene(const std::string& name);
+
+bool build_scene(const std::string& name, scene_description& scene);
+
+#endif // !SCENES_H
@@ -0,0 +1,167 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <vector>
+#include "memory.h"
+#include "cancel.h"
+
+enum class tile_order
+{
+	scanline,
+	spiral		// square rings around the image centre, so the middle finishes first
+};
+
+struct tile_settings
+{
+	int size = 8;						// also the unit in which adaptive sampling converges
+	tile_order order = tile_order::spiral;
+	bool report_timing = true;
+};
+
+struct tile_grid
+{
+	tile_grid(int image_width, int image_height, int tile_size)
+		: width(image_width), height(image_height), size(tile_size),
+		tiles_x((image_width + tile_size - 1) / tile_size), tiles_y((image_height + tile_size - 1) / tile_size) {}
+
+	int count() const { return tiles_x * tiles_y; }
+	int x0(int t) const { return (t % tiles_x) * size; }
+	int y0(int t) const { return (t / tiles_x) * size; }
+	int x1(int t) const { return std::min(x0(t) + size, width); }
+	int y1(int t) const { return std::min(y0(t) + size, height); }
+
+	// Tile indices in the order they should be handed out
+	std::vector<int> ordered(tile_order order) const
+	{
+		std::vector<int> tiles(count());
+		std::iota(tiles.begin(), tiles.end(), 0);
+		if (order == tile_order::spiral)
+		{
+			// Ring by Chebyshev distance from the centre tile, then by angle around it
+			const double cx = 0.5 * (tiles_x - 1), cy = 0.5 * (tiles_y - 1);
+			std::vector<std::pair<double, double>> key(tiles.size());
+			for (int t = 0; t < count(); t++)
+			{
+				double dx = t % tiles_x - cx, dy = t / tiles_x - cy;
+				key[t] = std::make_pair(std::max(fabs(dx), fabs(dy)), atan2(dy, dx));
+			}
+			std::stable_sort(tiles.begin(), tiles.end(), [&](int a, int b) { return key[a] < key[b]; });
+		}
+		return tiles;
+	}
+
+	int width, height, size;
+	int tiles_x, tiles_y;
+};
+
+// Hands tiles to render threads. The tiles are dealt round-robin in the given order, so every
+// thread starts near the front of it. A thread works through its own deque from the front,
+// and once that is empty it steals from the back of the others, taking the work their owners
+// would have reached last. Tiles are coarse, so a mutex per deque costs nothing measurable.
+// No tile is handed out once stop says so, so a time-limited or cancelled render stops
+// between tiles.
+class tile_scheduler
+{
+public:
+	tile_scheduler(const std::vector<int>& tiles, int threads, const cancel_token* stop = nullptr)
+		: queues(std::max(threads, 1)), stop(stop)
+	{
+		for (size_t k = 0; k < tiles.size(); k++)
+			queues[k % queues.size()].tiles.push_back(tiles[k]);
+	}
+
+	bool next(int thread, int& tile)
+	{
+		if (stop && stop->stop_requested())
+			return false;
+		const int n = static_cast<int>(queues.size());
+		thread %= n;
+		if (queues[thread].pop_front(tile))
+			return true;
+		for (int k = 1; k < n; k++)
+			if (queues[(thread + k) % n].pop_back(tile))
+			{
+				steals++;
+				return true;
+			}
+		return false;
+	}
+
+	std::atomic<int> steals{ 0 };
+
+private:
+	struct alignas(64) tile_queue
+	{
+		std::mutex lock;
+		std::deque<int> tiles;
+
+		bool pop_front(int& tile)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (tiles.empty())
+				return false;
+			tile = tiles.front();
+			tiles.pop_front();
+			return true;
+		}
+
+		bool pop_back(int& tile)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (tiles.empty())
+				return false;
+			tile = tiles.back();
+			tiles.pop_back();
+			return true;
+		}
+	};
+	std::vector<tile_queue, aligned_allocator<tile_queue, 64>> queues;
+	const cancel_token* stop;
+};
+
+// Where the render time went: the slowest tiles against the mean, and how evenly the threads
+// were kept busy.
+inline void print_tile_timing(const tile_grid& grid, const std::vector<double>& tile_seconds,
+	const std::vector<double>& thread_seconds, int steals, std::ostream& out)
+{
+	if (tile_seconds.empty())
+		return;
+	double total = std::accumulate(tile_seconds.begin(), tile_seconds.end(), 0.0);
+	double mean = total / tile_seconds.size();
+	std::vector<int> slowest(tile_seconds.size());
+	std::iota(slowest.begin(), slowest.end(), 0);
+	size_t shown = std::min<size_t>(5, slowest.size());
+	std::partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(),
+		[&](int a, int b) { return tile_seconds[a] > tile_seconds[b]; });
+
+	out << "Tile time (" << grid.count() << " tiles of " << grid.size << "x" << grid.size << "): mean "
+		<< mean * 1e3 << " ms, max " << tile_seconds[slowest[0]] * 1e3 << " ms ("
+		<< (mean > 0 ? tile_seconds[slowest[0]] / mean : 0) << "x mean), " << steals << " steals" << std::endl;
+	for (size_t k = 0; k < shown; k++)
+	{
+		int t = slowest[k];
+		out << "  tile at (" << grid.x0(t) << ", " << grid.y0(t) << "): " << tile_seconds[t] * 1e3 << " ms" << std::endl;
+	}
+
+	double busiest = 0, busy = 0;
+	int threads = 0;
+	for (double s : thread_seconds)
+		if (s > 0)
+		{
+			busiest = std::max(busiest, s);
+			busy += s;
+			threads++;
+		}
+	if (threads > 0)
+		out << "Thread busy time: mean " << busy / threads << " s, max " << busiest << " s over " << threads
+			<< " threads" << std::endl;
+}
+
+#endif // !SCHEDULER_H
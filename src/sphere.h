@@ -5,6 +5,28 @@
 #include "vec3.h"
 #include "onb.h"
 
+// Nearest root of the ray-sphere quadratic within [t_min, t_max].
+inline bool sphere_intersect(const ray& r, const point3& center, double radius, double t_min, double t_max, double& root)
+{
+	vec3 oc = r.origin() - center;
+	auto a = r.direction().length_squared();
+	auto half_b = dot(oc, r.direction());
+	auto c = oc.length_squared() - radius * radius;
+	auto discriminant = half_b * half_b - a * c;
+	if (discriminant < 0) return false;
+	auto sqrt_d = sqrt(discriminant);
+
+	// ҳ[t_min,t_max]еСֵ
+	root = (-half_b - sqrt_d) / a;
+	if (root < t_min || t_max < root)
+	{
+		root = (-half_b + sqrt_d) / a;
+		if (root < t_min || t_max < root)
+			return false;
+	}
+	return true;
+}
+
 class sphere : public hitable
 {
 public:
@@ -13,30 +35,27 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
 	{
-		vec3 oc = r.origin() - center;
-		auto a = r.direction().length_squared();
-		auto half_b = dot(oc, r.direction());
-		auto c = oc.length_squared() - radius * radius;
-		auto discriminant = half_b * half_b - a * c;
-		if (discriminant < 0) return false;
-		auto sqrt_d = sqrt(discriminant);
-
-		// ҳ[t_min,t_max]еСֵ
-		auto root = (-half_b - sqrt_d) / a;
-		if (root < t_min || t_max < root)
-		{
-			root = (-half_b + sqrt_d) / a;
-			if (root < t_min || t_max < root)
-				return false;
-		}
+		double root;
+		if (!sphere_intersect(r, center, radius, t_min, t_max, root))
+			return false;
 		rec.t = root;
+		rec.prim = this;
+		return true;
+	}
+
+	virtual void compute_surface_interaction(const ray& r, hit_record& rec) const override
+	{
 		rec.p = r.at(rec.t);
 		vec3 outward_normal = (rec.p - center) / radius;
 		rec.set_face_normal(r, outward_normal);
 		get_sphere_uv(outward_normal, rec.u, rec.v);
-		rec.mat_ptr = mat_ptr;
+		rec.mat_ptr = mat_ptr.get();
+	}
 
-		return true;
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		double root;
+		return sphere_intersect(r, center, radius, t_min, t_max, root);
 	}
 
 	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
@@ -60,12 +79,12 @@ public:
 			return 0;
 	}
 
-	virtual vec3 random(const vec3& o) const override
+	virtual vec3 random(const vec3& o, double r1, double r2) const override
 	{
 		vec3 direction = center - o;
 		double distance_squared = direction.length_squared();
 		onb uvw(direction);
-		return direction + uvw.local(random_to_sphere(radius, distance_squared));
+		return direction + uvw.local(random_to_sphere(radius, distance_squared, r1, r2));
 	}
 
 private:
@@ -5,7 +5,6 @@
 #include "vec3.h"
 #include "perlin.h"
 
-#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 class texture
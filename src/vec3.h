@@ -176,19 +176,44 @@ inline vec3 random_in_unit_disk()
 	}
 }
 
-inline vec3 random_cosine_direction()
+// Concentric mapping of a 2D sample onto the unit disk (Shirley and Chiu 1997); unlike
+// rejection it keeps stratified samples stratified.
+inline vec3 random_in_unit_disk(double r1, double r2)
+{
+	double a = 2 * r1 - 1, b = 2 * r2 - 1;
+	if (a == 0 && b == 0)
+		return vec3(0, 0, 0);
+	double r, theta;
+	if (fabs(a) > fabs(b))
+	{
+		r = a;
+		theta = (pi / 4) * (b / a);
+	}
+	else
+	{
+		r = b;
+		theta = pi / 2 - (pi / 4) * (a / b);
+	}
+	return vec3(r * cos(theta), r * sin(theta), 0);
+}
+
+inline vec3 random_cosine_direction(double r1, double r2)
 {
-	double r1 = random_double(), r2 = random_double();
 	double z = sqrt(1 - r2);
 	double phi = 2 * pi * r1;
-	double x = cos(phi) * 2 * sqrt(r2);
-	double y = sin(phi) * 2 * sqrt(r2);
+	double x = cos(phi) * sqrt(r2);
+	double y = sin(phi) * sqrt(r2);
 	return vec3(x, y, z);
 }
 
-inline vec3 random_to_sphere(double radius, double distance_squared)
+inline vec3 random_cosine_direction()
 {
 	double r1 = random_double(), r2 = random_double();
+	return random_cosine_direction(r1, r2);
+}
+
+inline vec3 random_to_sphere(double radius, double distance_squared, double r1, double r2)
+{
 	double z = 1 + r2 * (sqrt(1 - radius * radius / distance_squared) - 1);
 	double phi = 2 * pi * r1;
 	double x = cos(phi) * sqrt(1 - z * z);
@@ -196,12 +221,23 @@ inline vec3 random_to_sphere(double radius, double distance_squared)
 	return vec3(x, y, z);
 }
 
+inline vec3 random_to_sphere(double radius, double distance_squared)
+{
+	double r1 = random_double(), r2 = random_double();
+	return random_to_sphere(radius, distance_squared, r1, r2);
+}
+
+inline double luminance(const color& c)
+{
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 inline vec3 de_nan(const vec3& c)
 {
 	vec3 temp = c;
-	if (isnan(temp[0])) temp[0] = 0;
-	if (isnan(temp[1])) temp[1] = 0;
-	if (isnan(temp[2])) temp[2] = 0;
+	if (std::isnan(temp[0])) temp[0] = 0;
+	if (std::isnan(temp[1])) temp[1] = 0;
+	if (std::isnan(temp[2])) temp[2] = 0;
 	return temp;
 }
 
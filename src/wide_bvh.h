@@ -0,0 +1,333 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "rtweekend.h"
+#include "hitable.h"
+#include "hitable_list.h"
+#include "bvh.h"
+#include "linear_bvh.h"
+#include "memory.h"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define WIDE_BVH_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+// 8-wide nodes only pay off when a whole node fits one AVX register per plane
+#ifdef WIDE_BVH_AVX
+const int wide_bvh_default_width = 8;
+#else
+const int wide_bvh_default_width = 4;
+#endif
+
+// Bound on the relative error of the three float operations in a slab distance
+const float float_gamma3 = 3 * (std::numeric_limits<float>::epsilon() / 2) / (1 - 3 * (std::numeric_limits<float>::epsilon() / 2));
+
+// N children per node, bounds stored per plane so all children are tested with one vector op each.
+template <int N>
+struct alignas(64) wide_bvh_node
+{
+	float bounds[2][3][N];	// [min/max][axis][child]
+	uint32_t child[N];		// interior: node index, leaf: first primitive
+	uint32_t count[N];		// primitives of a leaf child, 0 for interior and empty slots
+};
+
+// Tests the ray against all N child boxes. Writes the entry distance of every child and
+// returns a bit mask of the children that are hit within [t_min, t_max].
+template <int N>
+inline int wide_slab_test(const wide_bvh_node<N>& node, const float o[3], const float inv_dir[3], const int dir_is_neg[3],
+	float t_min, float t_max, float t_near[N])
+{
+	int mask = 0;
+	for (int i = 0; i < N; i++)
+	{
+		float t0 = t_min, t1 = t_max;
+		for (int a = 0; a < 3; a++)
+		{
+			float tn = (node.bounds[dir_is_neg[a]][a][i] - o[a]) * inv_dir[a];
+			float tf = (node.bounds[1 - dir_is_neg[a]][a][i] - o[a]) * inv_dir[a];
+			t0 = tn > t0 ? tn : t0;
+			t1 = tf < t1 ? tf : t1;
+		}
+		t_near[i] = t0;
+		if (t0 <= t1 * (1 + 2 * float_gamma3))
+			mask |= 1 << i;
+	}
+	return mask;
+}
+
+#ifdef WIDE_BVH_SSE
+template <>
+inline int wide_slab_test<4>(const wide_bvh_node<4>& node, const float o[3], const float inv_dir[3], const int dir_is_neg[3],
+	float t_min, float t_max, float t_near[4])
+{
+	// max/min return their second operand when either is NaN, so the running interval goes second
+	__m128 t0 = _mm_set1_ps(t_min), t1 = _mm_set1_ps(t_max);
+	for (int a = 0; a < 3; a++)
+	{
+		__m128 org = _mm_set1_ps(o[a]), inv = _mm_set1_ps(inv_dir[a]);
+		__m128 tn = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[dir_is_neg[a]][a]), org), inv);
+		__m128 tf = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - dir_is_neg[a]][a]), org), inv);
+		t0 = _mm_max_ps(tn, t0);
+		t1 = _mm_min_ps(tf, t1);
+	}
+	t1 = _mm_mul_ps(t1, _mm_set1_ps(1 + 2 * float_gamma3));
+	_mm_storeu_ps(t_near, t0);
+	return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+#ifdef WIDE_BVH_AVX
+template <>
+inline int wide_slab_test<8>(const wide_bvh_node<8>& node, const float o[3], const float inv_dir[3], const int dir_is_neg[3],
+	float t_min, float t_max, float t_near[8])
+{
+	__m256 t0 = _mm256_set1_ps(t_min), t1 = _mm256_set1_ps(t_max);
+	for (int a = 0; a < 3; a++)
+	{
+		__m256 org = _mm256_set1_ps(o[a]), inv = _mm256_set1_ps(inv_dir[a]);
+		__m256 tn = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[dir_is_neg[a]][a]), org), inv);
+		__m256 tf = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[1 - dir_is_neg[a]][a]), org), inv);
+		t0 = _mm256_max_ps(tn, t0);
+		t1 = _mm256_min_ps(tf, t1);
+	}
+	t1 = _mm256_mul_ps(t1, _mm256_set1_ps(1 + 2 * float_gamma3));
+	_mm256_storeu_ps(t_near, t0);
+	return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+// A BVH with N-way nodes, built by collapsing the binary split hierarchy: every node keeps
+// splitting its largest child until it has N of them.
+template <int N>
+class wide_bvh : public hitable
+{
+public:
+	wide_bvh() = delete;
+	wide_bvh(const hitable_list& list, double time0, double time1, const bvh_build_options& options = bvh_build_options())
+	{
+		bvh_builder builder(list.objects, time0, time1, options);
+		build_seconds = builder.build_seconds;
+		primitives = std::move(builder.ordered);
+		if (!builder.root)
+			return;
+		// Collapsing never deepens the tree, and each level leaves at most N entries on the stack
+		assert(builder.max_depth <= bvh_max_depth);
+		root_box = builder.root->box;
+		if (builder.root->is_leaf())
+		{
+			// Wrap a single leaf so traversal always starts at an interior node
+			nodes.push_back(empty_node());
+			set_child(nodes[0], 0, *builder.root);
+		}
+		else
+			collapse(*builder.root);
+	}
+
+	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+	{
+		if (nodes.empty())
+			return false;
+		// A NaN ray passes every slab test, the inverted boxes of empty slots included
+		if (std::isnan(dot(r.origin(), r.origin()) + dot(r.direction(), r.direction())))
+			return false;
+
+		const float o[3] = { (float)r.origin().x(), (float)r.origin().y(), (float)r.origin().z() };
+		const float inv_dir[3] = { 1.0f / (float)r.direction().x(), 1.0f / (float)r.direction().y(), 1.0f / (float)r.direction().z() };
+		const int dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+		struct stack_entry
+		{
+			uint32_t child;
+			uint32_t count;
+			float t_near;
+		};
+		stack_entry stack[bvh_max_depth * N];
+		int stack_size = 0;
+		stack[stack_size++] = { 0, 0, float_round_down(t_min) };
+
+		bool hit_anything = false;
+		alignas(32) float t_near[N];
+		while (stack_size > 0)
+		{
+			const stack_entry entry = stack[--stack_size];
+			if (entry.t_near > t_max)
+				continue;
+			if (entry.count > 0)
+			{
+				for (uint32_t i = 0; i < entry.count; i++)
+					if (primitives[entry.child + i]->hit(r, t_min, t_max, rec))
+					{
+						hit_anything = true;
+						t_max = rec.t;
+					}
+				continue;
+			}
+
+			const wide_bvh_node<N>& node = nodes[entry.child];
+			int mask = wide_slab_test<N>(node, o, inv_dir, dir_is_neg, float_round_down(t_min), float_round_up(t_max), t_near);
+
+			// Push the hit children far-to-near so the nearest one is popped first
+			int first = stack_size;
+			for (; mask; mask &= mask - 1)
+			{
+				int i = lowest_bit(mask);
+				stack_entry e = { node.child[i], node.count[i], t_near[i] };
+				int j = stack_size++;
+				while (j > first && stack[j - 1].t_near < e.t_near)
+				{
+					stack[j] = stack[j - 1];
+					j--;
+				}
+				stack[j] = e;
+			}
+		}
+		return hit_anything;
+	}
+
+	// Any hit ends the traversal, so children are pushed unsorted
+	virtual bool occluded(const ray& r, double t_min, double t_max) const override
+	{
+		if (nodes.empty())
+			return false;
+		if (std::isnan(dot(r.origin(), r.origin()) + dot(r.direction(), r.direction())))
+			return false;
+
+		const float o[3] = { (float)r.origin().x(), (float)r.origin().y(), (float)r.origin().z() };
+		const float inv_dir[3] = { 1.0f / (float)r.direction().x(), 1.0f / (float)r.direction().y(), 1.0f / (float)r.direction().z() };
+		const int dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+		const float t_lo = float_round_down(t_min), t_hi = float_round_up(t_max);
+
+		uint32_t stack[bvh_max_depth * N];
+		int stack_size = 0;
+		stack[stack_size++] = 0;
+		alignas(32) float t_near[N];
+		while (stack_size > 0)
+		{
+			const wide_bvh_node<N>& node = nodes[stack[--stack_size]];
+			int mask = wide_slab_test<N>(node, o, inv_dir, dir_is_neg, t_lo, t_hi, t_near);
+			for (; mask; mask &= mask - 1)
+			{
+				int i = lowest_bit(mask);
+				if (node.count[i] == 0)
+				{
+					stack[stack_size++] = node.child[i];
+					continue;
+				}
+				for (uint32_t k = 0; k < node.count[i]; k++)
+					if (primitives[node.child[i] + k]->occluded(r, t_min, t_max))
+						return true;
+			}
+		}
+		return false;
+	}
+
+	virtual bool bounding_box(double time0, double time1, aabb& output_box) const override
+	{
+		if (nodes.empty())
+			return false;
+		output_box = root_box;
+		return true;
+	}
+
+private:
+	static wide_bvh_node<N> empty_node()
+	{
+		wide_bvh_node<N> node;
+		for (int i = 0; i < N; i++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				// An inverted box that no ray can enter
+				node.bounds[0][a][i] = std::numeric_limits<float>::infinity();
+				node.bounds[1][a][i] = -std::numeric_limits<float>::infinity();
+			}
+			node.child[i] = 0;
+			node.count[i] = 0;
+		}
+		return node;
+	}
+
+	static int lowest_bit(int mask)
+	{
+		int i = 0;
+		while (!(mask & (1 << i)))
+			i++;
+		return i;
+	}
+
+	void set_child(wide_bvh_node<N>& node, int i, const bvh_build_node& c)
+	{
+		// Pad the float box so that rounding the ray origin to float cannot produce a false miss
+		double scale = 1.0;
+		for (int a = 0; a < 3; a++)
+			scale = fmax(scale, fmax(fabs(c.box.min()[a]), fabs(c.box.max()[a])));
+		double pad = 1e-5 * scale;
+		for (int a = 0; a < 3; a++)
+		{
+			node.bounds[0][a][i] = float_round_down(c.box.min()[a] - pad);
+			node.bounds[1][a][i] = float_round_up(c.box.max()[a] + pad);
+		}
+		if (c.is_leaf())
+		{
+			node.child[i] = static_cast<uint32_t>(c.start);
+			node.count[i] = static_cast<uint32_t>(c.end - c.start);
+		}
+	}
+
+	// Emits an interior node for a binary interior node, pulling up grandchildren until it has N children.
+	uint32_t collapse(const bvh_build_node& build_node)
+	{
+		const bvh_build_node* children[N];
+		int n = 1;
+		children[0] = &build_node;
+
+		// Open up the interior child with the largest surface area until the node is full
+		while (n < N)
+		{
+			int best = -1;
+			double best_area = -1;
+			for (int i = 0; i < n; i++)
+				if (!children[i]->is_leaf() && children[i]->box.surface_area() > best_area)
+				{
+					best = i;
+					best_area = children[i]->box.surface_area();
+				}
+			if (best < 0)
+				break;
+			const bvh_build_node* c = children[best];
+			children[best] = c->children[0].get();
+			children[n++] = c->children[1].get();
+		}
+
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(empty_node());
+		for (int i = 0; i < n; i++)
+		{
+			uint32_t child = children[i]->is_leaf() ? 0 : collapse(*children[i]);
+			// nodes may have been reallocated by the recursive call
+			set_child(nodes[index], i, *children[i]);
+			if (!children[i]->is_leaf())
+				nodes[index].child[i] = child;
+		}
+		return index;
+	}
+
+public:
+	std::vector<wide_bvh_node<N>, aligned_allocator<wide_bvh_node<N>, 64>> nodes;
+	std::vector<shared_ptr<hitable>> primitives;	// leaf order
+	aabb root_box;
+	double build_seconds = 0;
+};
+
+typedef wide_bvh<4> bvh4;
+typedef wide_bvh<8> bvh8;
+
+#endif // !WIDE_BVH_H